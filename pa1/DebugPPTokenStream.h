@@ -3,75 +3,81 @@
 #pragma once
 
 #include "IPPTokenStream.h"
+#include "OutputBuffer.h"
 
-struct DebugPPTokenStream : IPPTokenStream
+struct DebugPPTokenStream : IPPTokenViewStream
 {
+	DebugPPTokenStream() : out(STDOUT_FILENO) {}
+
 	void emit_whitespace_sequence()
 	{
-		cout << "whitespace-sequence 0 " << endl;
+		out << "whitespace-sequence 0 \n";
 	}
 
 	void emit_new_line()
 	{
-		cout << "new-line 0 " << endl;
+		out << "new-line 0 \n";
 	}
 
-	void emit_header_name(const string& data)
+	void emit_header_name(const PPTokenView& data)
 	{
 		write_token("header-name", data);
 	}
 
-	void emit_identifier(const string& data)
+	void emit_identifier(const PPTokenView& data)
 	{
 		write_token("identifier", data);
 	}
 
-	void emit_pp_number(const string& data)
+	void emit_pp_number(const PPTokenView& data)
 	{
 		write_token("pp-number", data);
 	}
 
-	void emit_character_literal(const string& data)
+	void emit_character_literal(const PPTokenView& data)
 	{
 		write_token("character-literal", data);
 	}
 
-	void emit_user_defined_character_literal(const string& data)
+	void emit_user_defined_character_literal(const PPTokenView& data)
 	{
 		write_token("user-defined-character-literal", data);
 	}
 
-	void emit_string_literal(const string& data)
+	void emit_string_literal(const PPTokenView& data)
 	{
 		write_token("string-literal", data);
 	}
 
-	void emit_user_defined_string_literal(const string& data)
+	void emit_user_defined_string_literal(const PPTokenView& data)
 	{
 		write_token("user-defined-string-literal", data);
 	}
 
-	void emit_preprocessing_op_or_punc(const string& data)
+	void emit_preprocessing_op_or_punc(const PPTokenView& data)
 	{
 		write_token("preprocessing-op-or-punc", data);
 	}
 
-	void emit_non_whitespace_char(const string& data)
+	void emit_non_whitespace_char(const PPTokenView& data)
 	{
 		write_token("non-whitespace-character", data);
 	}
 
 	void emit_eof()
 	{
-		cout << "eof" << endl;
+		out << "eof\n";
+		out.flush();
 	}
 
 private:
 
-	void write_token(const string& type, const string& data)
+	void write_token(const char* type, const PPTokenView& data)
 	{
-		cout << type << " " << data.size() << " ";
-		cout.write(data.data(), data.size());
-		cout << endl;
+		out << type << ' ' << data.size << ' ';
+		out.write(data.data, data.size);
+		out << '\n';
 	}
+
+	OutputBuffer out;
 };
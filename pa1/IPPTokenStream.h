@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstring>
+#include <string>
+
 struct IPPTokenStream
 {
 	virtual void emit_whitespace_sequence() = 0;
@@ -17,3 +20,64 @@ struct IPPTokenStream
 
 	virtual ~IPPTokenStream() {}
 };
+
+// PPTokenView: spelling of a pp-token, only valid during the emit_* call.
+// When phases 1-2 left the token untouched (no trigraph, splice or UCN)
+// data points into the buffer passed to PPTokenizer::process(begin, end);
+// otherwise it points into a spelling owned by the tokenizer.
+struct PPTokenView
+{
+	const char* data;
+	size_t size;
+
+	string str() const
+	{
+		return string(data, size);
+	}
+
+	bool operator==(const char* s) const
+	{
+		return std::strlen(s) == size && std::memcmp(data, s, size) == 0;
+	}
+};
+
+// IPPTokenViewStream: IPPTokenStream variant receiving spellings as views
+struct IPPTokenViewStream
+{
+	virtual void emit_whitespace_sequence() = 0;
+	virtual void emit_new_line() = 0;
+	virtual void emit_header_name(const PPTokenView& data) = 0;
+	virtual void emit_identifier(const PPTokenView& data) = 0;
+	virtual void emit_pp_number(const PPTokenView& data) = 0;
+	virtual void emit_character_literal(const PPTokenView& data) = 0;
+	virtual void emit_user_defined_character_literal(const PPTokenView& data) = 0;
+	virtual void emit_string_literal(const PPTokenView& data) = 0;
+	virtual void emit_user_defined_string_literal(const PPTokenView& data) = 0;
+	virtual void emit_preprocessing_op_or_punc(const PPTokenView& data) = 0;
+	virtual void emit_non_whitespace_char(const PPTokenView& data) = 0;
+	virtual void emit_eof() = 0;
+
+	virtual ~IPPTokenViewStream() {}
+};
+
+// PPTokenViewStreamAdapter: forwards views to an IPPTokenStream as strings
+struct PPTokenViewStreamAdapter : IPPTokenViewStream
+{
+	explicit PPTokenViewStreamAdapter(IPPTokenStream& output) : output(output) {}
+
+	void emit_whitespace_sequence() { output.emit_whitespace_sequence(); }
+	void emit_new_line() { output.emit_new_line(); }
+	void emit_header_name(const PPTokenView& data) { output.emit_header_name(data.str()); }
+	void emit_identifier(const PPTokenView& data) { output.emit_identifier(data.str()); }
+	void emit_pp_number(const PPTokenView& data) { output.emit_pp_number(data.str()); }
+	void emit_character_literal(const PPTokenView& data) { output.emit_character_literal(data.str()); }
+	void emit_user_defined_character_literal(const PPTokenView& data) { output.emit_user_defined_character_literal(data.str()); }
+	void emit_string_literal(const PPTokenView& data) { output.emit_string_literal(data.str()); }
+	void emit_user_defined_string_literal(const PPTokenView& data) { output.emit_user_defined_string_literal(data.str()); }
+	void emit_preprocessing_op_or_punc(const PPTokenView& data) { output.emit_preprocessing_op_or_punc(data.str()); }
+	void emit_non_whitespace_char(const PPTokenView& data) { output.emit_non_whitespace_char(data.str()); }
+	void emit_eof() { output.emit_eof(); }
+
+private:
+	IPPTokenStream& output;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// OutputBuffer: collects output in a reusable buffer and hands it to write(2)
+// only when the buffer fills up or on flush(), instead of once per line
+struct OutputBuffer
+{
+	static const size_t Capacity = 1 << 16;
+
+	explicit OutputBuffer(int fd) : fd_(fd), buffer_(Capacity), size_(0), next_(live())
+	{
+		live() = this;
+	}
+
+	OutputBuffer(const OutputBuffer&) = delete;
+	OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+	// whatever is still buffered when an error unwinds the stack
+	~OutputBuffer()
+	{
+		drain();
+		OutputBuffer** p = &live();
+		while (*p != this)
+			p = &(*p)->next_;
+		*p = next_;
+	}
+
+	// writes out every live buffer, for exits that skip the destructors
+	static void drainAll()
+	{
+		for (OutputBuffer* p = live(); p != nullptr; p = p->next_)
+			p->drain();
+	}
+
+	OutputBuffer& operator<<(char c)
+	{
+		if (size_ == Capacity)
+			flush();
+		buffer_[size_++] = c;
+		return *this;
+	}
+
+	OutputBuffer& operator<<(const char* s)
+	{
+		return write(s, strlen(s));
+	}
+
+	OutputBuffer& operator<<(const string& s)
+	{
+		return write(s.data(), s.size());
+	}
+
+	// decimal
+	OutputBuffer& operator<<(size_t n)
+	{
+		char digits[20];
+		size_t i = sizeof digits;
+		do
+		{
+			digits[--i] = static_cast<char>('0' + n % 10);
+			n /= 10;
+		}
+		while (n != 0);
+		return write(digits + i, sizeof digits - i);
+	}
+
+	OutputBuffer& write(const char* p, size_t n)
+	{
+		if (n > Capacity - size_)
+		{
+			flush();
+			if (n >= Capacity)
+			{
+				if (!writeAll(p, n))
+					throw runtime_error(string("write error: ") + strerror(errno));
+				return *this;
+			}
+		}
+		memcpy(&buffer_[size_], p, n);
+		size_ += n;
+		return *this;
+	}
+
+	void flush()
+	{
+		if (!drain())
+			throw runtime_error(string("write error: ") + strerror(errno));
+	}
+
+private:
+	// the buffers not yet destroyed, most recent first
+	static OutputBuffer*& live()
+	{
+		static OutputBuffer* head = nullptr;
+		return head;
+	}
+
+	bool drain()
+	{
+		size_t n = size_;
+		size_ = 0;
+		return writeAll(buffer_.data(), n);
+	}
+
+	bool writeAll(const char* p, size_t n)
+	{
+		while (n > 0)
+		{
+			ssize_t written = ::write(fd_, p, n);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			p += written;
+			n -= written;
+		}
+		return true;
+	}
+
+	int fd_;
+	vector<char> buffer_;
+	size_t size_;
+	OutputBuffer* next_;
+};
@@ -0,0 +1,136 @@
+// Table-driven UTF-8 decoder after Bjoern Hoehrmann's DFA.
+//
+// Every byte is mapped to one of twelve classes and the class, together with
+// the current state, picks the next state from a single transition table, so
+// decoding a code unit is two table lookups and no branches on the byte value.
+// Overlong forms, surrogates and code points beyond U+10FFFF never reach the
+// accepting state. A buffer that has been run through the automaton up front
+// can then be decoded without any checks.
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static const uint32_t Utf8Accept = 0;
+static const uint32_t Utf8Reject = 12;
+
+// states after the lead bytes ed and f4, whose trailing byte would otherwise
+// start a surrogate or a code point beyond U+10FFFF
+static const uint32_t Utf8AfterED = 60;
+static const uint32_t Utf8AfterF4 = 96;
+
+static const uint8_t Utf8DecodeTable[] = {
+	// byte classes
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 00..0f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 10..1f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 20..2f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 30..3f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 40..4f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 50..5f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 60..6f
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 70..7f
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 80..8f
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, // 90..9f
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, // a0..af
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, // b0..bf
+	8, 8, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // c0..cf
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // d0..df
+	10, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 4, 3, 3, // e0..ef
+	11, 6, 6, 6, 5, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, // f0..ff
+
+	// transitions, indexed by state + class
+	0, 12, 24, 36, 60, 96, 84, 12, 12, 12, 48, 72,      // accept
+	12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,     // reject
+	12, 0, 12, 12, 12, 12, 12, 0, 12, 0, 12, 12,        // one trailing byte left
+	12, 24, 12, 12, 12, 12, 12, 24, 12, 24, 12, 12,     // two left
+	12, 12, 12, 12, 12, 12, 12, 24, 12, 12, 12, 12,     // after e0: a0..bf
+	12, 24, 12, 12, 12, 12, 12, 12, 12, 24, 12, 12,     // after ed: 80..9f
+	12, 12, 12, 12, 12, 12, 12, 36, 12, 36, 12, 12,     // after f0: 90..bf
+	12, 36, 12, 12, 12, 12, 12, 36, 12, 36, 12, 12,     // three left
+	12, 36, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,     // after f4: 80..8f
+};
+
+// code units 10xxxxxx only continue a sequence
+static inline bool isUtf8Trailing(uint8_t byte)
+{
+	return (byte & 0xc0) == 0x80;
+}
+
+// feed one code unit to the decoder; code_point is complete once the returned
+// state is Utf8Accept
+static inline uint32_t decodeUtf8(uint32_t state, uint32_t &code_point, uint8_t byte)
+{
+	uint32_t type = Utf8DecodeTable[byte];
+	code_point = (state != Utf8Accept) ? (byte & 0x3fu) | (code_point << 6) : (0xffu >> type) & byte;
+	return Utf8DecodeTable[256 + state + type];
+}
+
+// decode the sequence at p, whose structure is already known to be valid,
+// and move p past it; surrogates encoded from universal-character-names
+// decode like any other code point
+static inline uint32_t decodeUtf8Unchecked(const char *&p)
+{
+	uint32_t c = static_cast<uint8_t>(*p++);
+	if (c < 0x80)
+		return c;
+	int trailing = c < 0xe0 ? 1 : c < 0xf0 ? 2 : 3;
+	uint32_t code_point = c & (0x3f >> trailing);
+	while (trailing-- > 0)
+		code_point = (code_point << 6) | (static_cast<uint8_t>(*p++) & 0x3f);
+	return code_point;
+}
+
+// end of the longest prefix of [p, end) that holds only complete, valid
+// sequences; runs of ASCII are passed over sixteen code units at a time
+static inline const char *findUtf8ValidEnd(const char *p, const char *end)
+{
+	const char *valid = p;
+	uint32_t state = Utf8Accept;
+
+	while (p != end)
+	{
+#if defined(__SSE2__)
+		if (state == Utf8Accept)
+		{
+			while (end - p >= 16 && _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) == 0)
+				p += 16;
+			valid = p;
+			if (p == end)
+				break;
+		}
+#endif
+		state = Utf8DecodeTable[256 + state + Utf8DecodeTable[static_cast<uint8_t>(*p++)]];
+		if (state == Utf8Accept)
+			valid = p;
+		else if (state == Utf8Reject)
+			break;
+	}
+	return valid;
+}
+
+// why byte was rejected in state
+static inline const char *utf8RejectReason(uint32_t state, uint8_t byte)
+{
+	bool trailing = isUtf8Trailing(byte);
+	if (state == Utf8Accept)
+	{
+		if (trailing)
+			return "utf8 trailing code unit (10xxxxxx) at start";
+		if (byte >= 0xf8)
+			return "utf8 invalid unit (11111xx)";
+		if (byte < 0xc2)
+			return "utf8 overlong encoding";
+		return "invalid code point";
+	}
+	if (!trailing)
+		return "utf8 expected trailing byte (10xxxxxx)";
+	if (state == Utf8AfterED)
+		return "utf8 surrogate code point";
+	if (state == Utf8AfterF4)
+		return "invalid code point";
+	return "utf8 overlong encoding";
+}
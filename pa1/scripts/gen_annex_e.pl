@@ -0,0 +1,128 @@
+#!/usr/bin/perl
+
+# Generates AnnexE.h: the identifier character ranges of C++ Annex E as
+# two-level bitmaps. Pages of 256 code points index into a list of distinct
+# 256-bit blocks, so that membership is two loads for any code point.
+#
+# Usage: scripts/gen_annex_e.pl > AnnexE.h
+
+use strict;
+use warnings;
+
+my $indent = "\t";
+
+# See C++ standard 2.11 Identifiers and Appendix/Annex E.1
+my @allowed = (
+	[0xA8,    0xA8],
+	[0xAA,    0xAA],
+	[0xAD,    0xAD],
+	[0xAF,    0xAF],
+	[0xB2,    0xB5],
+	[0xB7,    0xBA],
+	[0xBC,    0xBE],
+	[0xC0,    0xD6],
+	[0xD8,    0xF6],
+	[0xF8,    0xFF],
+	[0x100,   0x167F],
+	[0x1681,  0x180D],
+	[0x180F,  0x1FFF],
+	[0x200B,  0x200D],
+	[0x202A,  0x202E],
+	[0x203F,  0x2040],
+	[0x2054,  0x2054],
+	[0x2060,  0x206F],
+	[0x2070,  0x218F],
+	[0x2460,  0x24FF],
+	[0x2776,  0x2793],
+	[0x2C00,  0x2DFF],
+	[0x2E80,  0x2FFF],
+	[0x3004,  0x3007],
+	[0x3021,  0x302F],
+	[0x3031,  0x303F],
+	[0x3040,  0xD7FF],
+	[0xF900,  0xFD3D],
+	[0xFD40,  0xFDCF],
+	[0xFDF0,  0xFE44],
+	[0xFE47,  0xFFFD],
+	[0x10000, 0x1FFFD],
+	[0x20000, 0x2FFFD],
+	[0x30000, 0x3FFFD],
+	[0x40000, 0x4FFFD],
+	[0x50000, 0x5FFFD],
+	[0x60000, 0x6FFFD],
+	[0x70000, 0x7FFFD],
+	[0x80000, 0x8FFFD],
+	[0x90000, 0x9FFFD],
+	[0xA0000, 0xAFFFD],
+	[0xB0000, 0xBFFFD],
+	[0xC0000, 0xCFFFD],
+	[0xD0000, 0xDFFFD],
+	[0xE0000, 0xEFFFD],
+);
+
+# See C++ standard 2.11 Identifiers and Appendix/Annex E.2
+my @disallowed_initially = (
+	[0x300,  0x36F],
+	[0x1DC0, 0x1DFF],
+	[0x20D0, 0x20FF],
+	[0xFE20, 0xFE2F],
+);
+
+my $page_count = 0x1100;
+
+sub emit_set
+{
+	my ($name, @ranges) = @_;
+
+	my (@pages, @blocks, %block_index);
+	for my $page (0 .. $page_count - 1)
+	{
+		my @words = (0, 0, 0, 0);
+		for my $c ($page << 8 .. ($page << 8) + 0xFF)
+		{
+			for my $r (@ranges)
+			{
+				if ($c >= $r->[0] && $c <= $r->[1])
+				{
+					$words[($c >> 6) & 3] |= 1 << ($c & 63);
+					last;
+				}
+			}
+		}
+		my $key = join(",", map { sprintf("0x%016x", $_) } @words);
+		if (!exists $block_index{$key})
+		{
+			$block_index{$key} = scalar(@blocks);
+			push @blocks, $key;
+		}
+		push @pages, $block_index{$key};
+	}
+	die "too many blocks for $name" if @blocks > 256;
+
+	printf "static const uint8_t %sPages[0x%x] = {\n", $name, $page_count;
+	for (my $i = 0; $i < @pages; $i += 32)
+	{
+		my $last = $i + 31 < $#pages ? $i + 31 : $#pages;
+		print $indent, join(", ", @pages[$i .. $last]), ",\n";
+	}
+	print "};\n\n";
+
+	print "static const uint64_t ${name}Blocks[][4] = {\n";
+	for my $block (@blocks)
+	{
+		print $indent, "{", join(", ", split(/,/, $block)), "},\n";
+	}
+	print "};\n\n";
+}
+
+print "// Generated by scripts/gen_annex_e.pl, do not edit.\n";
+print "//\n";
+print "// Identifier character ranges of C++ Annex E as two-level bitmaps: the\n";
+print "// page of a code point, c >> 8, selects one of the distinct 256-bit blocks.\n";
+print "\n";
+print "#pragma once\n";
+print "\n";
+print "#include <cstdint>\n";
+print "\n";
+emit_set("AnnexE1_Allowed", @allowed);
+emit_set("AnnexE2_DisallowedInitially", @disallowed_initially);
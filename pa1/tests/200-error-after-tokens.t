@@ -0,0 +1,2 @@
+int foo = 1;
+char c = '//
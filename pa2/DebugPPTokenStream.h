@@ -3,14 +3,16 @@
 #pragma once
 
 #include <string>
-#include <list>
 #include <vector>
 #include <deque>
+#include <memory>
 #include "IPPTokenStream.h"
+#include "OutputBuffer.h"
 
 #ifndef NDEBUG
 #define ASSERT(cond, msg) do {\
   if (!(cond)) {\
+    OutputBuffer::drainAll();\
     std::cerr << "error:" << __FILE__ << ":" << __LINE__ << "  " << (msg) << std::endl;\
     std::exit(EXIT_FAILURE);\
   }\
@@ -48,10 +50,15 @@ struct PPTokenizer {
 
   PPTokenizer(IPPTokenStream &output);
 
+  PPTokenizer(IPPTokenViewStream &output);
+
   void process(int c);
 
+  void process(const char *begin, const char *end);
+
 private:
-  IPPTokenStream &output;
+  std::unique_ptr<IPPTokenViewStream> adapter_;
+  IPPTokenViewStream &output;
 private:
   enum DecodeState {
     D_None,
@@ -81,10 +88,10 @@ private:
     S_UserDefinedNormalStringLiteral,
     S_StartRawStringLiteralDChar,
     S_StartRawStringLiteralRChar,
-    S_MayBeEndRawStringLiteralRChar,
     S_EndRawStringLiteral,
     S_UserDefinedRawStringLiteral,
     S_StartOpOrPunc,
+    S_Count
   };
 
   enum InnerState {
@@ -96,6 +103,8 @@ private:
   };
 
 private:
+  void init();
+
   void beginUTF8State(int c);
 
   bool decode_None(int c);
@@ -112,18 +121,76 @@ private:
 
   bool decode_MayBeTriGraph2(int c);
 
+  void trackCommentBackSlash(int c);
+
   void decode_SingleLineComment(int c);
 
   void decode_InlineComment(int c);
 
+  bool isInlineCommentEnd(int c) const;
+
   void decode_MayEndInlineComment(int c);
 
+  // bulk paths for comment bodies: return the code unit that ends the
+  // comment, or end
+  const char *skipLineComment(const char *p, const char *end);
+
+  const char *skipInlineComment(const char *p, const char *end);
+
+  bool isTransparentCodeUnit(int c) const;
+
   bool decode(int c);
 
+  // classes of code points that StepTable tells apart
+  enum StepClass {
+    SC_Other,  // EOF and code points outside ASCII
+    SC_Letter, // [_a-zA-Z] but e and E
+    SC_E,      // e, E
+    SC_Digit,
+    SC_Dot,
+    SC_Sign,   // +, -
+    SC_Quote,  // ', "
+    SC_Space,  // white-space characters but new-line
+    SC_Break,  // any other ASCII character
+    SC_Count
+  };
+
+  // what step() does with a code point before falling back to the step_*
+  // function of the current state
+  enum StepAction {
+    A_Step,       // call the step_* function
+    A_Append,     // append to the token
+    A_AppendGoto, // append to the token and go to the next state
+    A_Emit,       // the token ends before the code point
+    A_Begin,      // start a token in the next state
+    A_Space,      // white space outside of a token
+  };
+
+  struct StepEntry {
+    unsigned char action;
+    unsigned char next;
+  };
+
+  static constexpr unsigned char stepClassOf(int c);
+
+  static constexpr StepEntry stepEntry(int state, int cls);
+
+  static const unsigned char StepClassTable[256];
+
+  static const StepEntry StepTable[S_Count][SC_Count];
+
   void step(int cp);
 
+  void append(int c);
+
+  void appendRun(const char *begin, const char *end);
+
+  PPTokenView spelling();
+
   void emit(int c, bool cont);
 
+  void emitOpOrPunc(const PPTokenView &data);
+
   void step_None(int c);
 
   void step_Identifier(int c);
@@ -134,12 +201,16 @@ private:
 
   void step_HeaderName(int c);
 
-  std::vector<int> splitOpOrPunc(std::string &data, int c);
-
   void step_OpOrPunc(int c);
 
+  void splitOpOrPunc(int c);
+
   void step_StartCharacterLiteral(int c);
 
+  // bulk path for string and character literal bodies: returns the first
+  // code unit it did not consume
+  const char *scanQuotedLiteralBody(const char *p, const char *end);
+
   void step_EndCharacterLiteral(int c);
 
   void step_UserDefinedCharacterLiteral(int c);
@@ -154,7 +225,11 @@ private:
 
   void step_StartRawStringLiteralRChar(int c);
 
-  void step_MayBeEndRawStringLiteralRChar(int c);
+  bool isRawStringLiteralEnd() const;
+
+  // bulk path for raw string bodies: returns the first code unit it did not
+  // consume
+  const char *scanRawStringBody(const char *p, const char *end);
 
   void step_EndRawStringLiteral(int c);
 
@@ -165,15 +240,37 @@ private:
 private:
   // variables for translation task
   std::string buffer_;
-  int counts_;
+  uint32_t utf8_state_;
+  uint32_t utf8_code_point_;
+  int utf8_trailing_;
+  const char *utf8_reject_reason_;
   DecodeState decode_state_;
   std::deque<int> code_points_;
   int last_code_point_;
   int last_but_one_code_point_;
   bool is_prev_back_slash_;
+  // trailing '?' code units of a comment, up to the two of a trigraph
+  int comment_question_marks_;
 
   // variables for tokenization task
-  std::vector<int> data_;
+
+  // UTF-8 spelling of the current token
+  std::string data_;
+
+  // source byte of the code point being stepped, nullptr if phases 1-2
+  // produced it rather than copied it from the input
+  const char *cursor_;
+
+  // next input byte not yet matched by a decoded code point
+  const char *source_;
+
+  // source range of the current token while it is a verbatim copy of the
+  // input, token_begin_ is nullptr otherwise
+  const char *token_begin_;
+  const char *token_end_;
+
+  // spelling of the last non-whitespace-character
+  std::string spelling_;
 
   bool is_prev_whitespace_;
 
@@ -187,15 +284,30 @@ private:
 
   // used for raw string
   bool is_raw_string_mode_;
-  bool is_prev_right_paren_;
-  std::vector<int> prefix_;
-  std::vector<int>::size_type compare_index_;
+  // UTF-8 spelling of the d-char-sequence
+  std::string prefix_;
+
+  // used for preprocessing-op-or-punc: trie node of the candidate
+  int op_node_;
 
   State state_;
   InnerState inner_state_;
 };
 
-struct DebugPPTokenStream : IPPTokenStream {
+// PPTokenConsumer: the next phase, taking pp-tokens one at a time
+struct PPTokenConsumer {
+  // token is only valid during the call; the consumer may move its
+  // spelling out to keep it
+  virtual void process(PPToken &token) = 0;
+
+  virtual ~PPTokenConsumer() {}
+};
+
+struct DebugPPTokenStream : IPPTokenViewStream {
+  // every token is handed to the consumer as soon as it is emitted, so that
+  // phase 7 keeps pace with the tokenizer when phases 1-3 fail later on
+  explicit DebugPPTokenStream(PPTokenConsumer &consumer) : consumer(consumer) {}
+
   void emit_whitespace_sequence() {
     /* do nothing */
   }
@@ -204,61 +316,56 @@ struct DebugPPTokenStream : IPPTokenStream {
     /* do nothing */
   }
 
-  void emit_header_name(const std::string &data) {
+  void emit_header_name(const PPTokenView &data) {
     emit(PPTokenType::Tk_HeaderName, data);
   }
 
-  void emit_identifier(const std::string &data) {
+  void emit_identifier(const PPTokenView &data) {
     emit(PPTokenType::Tk_Identifier, data);
   }
 
-  void emit_pp_number(const std::string &data) {
+  void emit_pp_number(const PPTokenView &data) {
     emit(PPTokenType::Tk_PPNumber, data);
   }
 
-  void emit_character_literal(const std::string &data) {
+  void emit_character_literal(const PPTokenView &data) {
     emit(PPTokenType::Tk_CharacterLiteral, data);
   }
 
-  void emit_user_defined_character_literal(const std::string &data) {
+  void emit_user_defined_character_literal(const PPTokenView &data) {
     emit(PPTokenType::Tk_UdCharacterLiteral, data);
   }
 
-  void emit_string_literal(const std::string &data) {
+  void emit_string_literal(const PPTokenView &data) {
     emit(PPTokenType::Tk_StringLiteral, data);
   }
 
-  void emit_user_defined_string_literal(const std::string &data) {
+  void emit_user_defined_string_literal(const PPTokenView &data) {
     emit(PPTokenType::Tk_UdStringLiteral, data);
   }
 
-  void emit_preprocessing_op_or_punc(const std::string &data) {
+  void emit_preprocessing_op_or_punc(const PPTokenView &data) {
     emit(PPTokenType::Tk_OpOrPunc, data);
   }
 
-  void emit_non_whitespace_char(const std::string &data) {
+  void emit_non_whitespace_char(const PPTokenView &data) {
     emit(PPTokenType::Tk_NonWhitespaceChar, data);
   }
 
   void emit_eof() {
-    emit(PPTokenType::Tk_EOF, "");
-  }
-
-  PPToken next() {
-    PPToken t = tokens.front();
-    tokens.pop_front();
-    return t;
-  }
-
-  bool empty() {
-    return tokens.empty();
+    emit(PPTokenType::Tk_EOF, PPTokenView{"", 0});
   }
 
 private:
-  std::list<PPToken> tokens;
-
-  void emit(PPTokenType type, const std::string &data) {
-    tokens.emplace_back(PPToken(type, data));
+  // the one slot every token passes through; its string keeps its storage
+  // for the next token unless the consumer took the spelling
+  PPToken token;
+  PPTokenConsumer &consumer;
+
+  void emit(PPTokenType type, const PPTokenView &data) {
+    token.type = type;
+    token.data.assign(data.data, data.size);
+    consumer.process(token);
   }
 };
 
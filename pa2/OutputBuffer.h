@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// a memory range to be written as upper-case hex, two digits per byte
+struct HexBytes {
+  const void *data;
+  size_t size;
+};
+
+// OutputBuffer: collects output in a reusable buffer and hands it to write(2)
+// only when the buffer fills up or on flush(), instead of once per line
+struct OutputBuffer {
+  static const size_t Capacity = 1 << 16;
+
+  explicit OutputBuffer(int fd) : fd_(fd), buffer_(Capacity), size_(0), next_(live()) {
+    live() = this;
+  }
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  // whatever is still buffered when an error unwinds the stack
+  ~OutputBuffer() {
+    drain();
+    OutputBuffer **p = &live();
+    while (*p != this) {
+      p = &(*p)->next_;
+    }
+    *p = next_;
+  }
+
+  // writes out every live buffer, for exits that skip the destructors
+  static void drainAll() {
+    for (OutputBuffer *p = live(); p != nullptr; p = p->next_) {
+      p->drain();
+    }
+  }
+
+  OutputBuffer &operator<<(char c) {
+    if (size_ == Capacity) {
+      flush();
+    }
+    buffer_[size_++] = c;
+    return *this;
+  }
+
+  OutputBuffer &operator<<(const char *s) {
+    return write(s, strlen(s));
+  }
+
+  OutputBuffer &operator<<(const std::string &s) {
+    return write(s.data(), s.size());
+  }
+
+  // decimal
+  OutputBuffer &operator<<(size_t n) {
+    char digits[20];
+    size_t i = sizeof digits;
+    do {
+      digits[--i] = static_cast<char>('0' + n % 10);
+      n /= 10;
+    } while (n != 0);
+    return write(digits + i, sizeof digits - i);
+  }
+
+  // encoded straight into the buffer, chunk by chunk for long ranges
+  OutputBuffer &operator<<(const HexBytes &hex) {
+    const unsigned char *p = static_cast<const unsigned char *>(hex.data);
+    size_t n = hex.size;
+    while (n > 0) {
+      if (Capacity - size_ < 2) {
+        flush();
+      }
+      size_t chunk = std::min(n, (Capacity - size_) / 2);
+      encodeHex(p, chunk, &buffer_[size_]);
+      size_ += 2 * chunk;
+      p += chunk;
+      n -= chunk;
+    }
+    return *this;
+  }
+
+  OutputBuffer &write(const char *p, size_t n) {
+    if (n > Capacity - size_) {
+      flush();
+      if (n >= Capacity) {
+        if (!writeAll(p, n)) {
+          throw std::runtime_error(std::string("write error: ") + strerror(errno));
+        }
+        return *this;
+      }
+    }
+    memcpy(&buffer_[size_], p, n);
+    size_ += n;
+    return *this;
+  }
+
+  void flush() {
+    if (!drain()) {
+      throw std::runtime_error(std::string("write error: ") + strerror(errno));
+    }
+  }
+
+  // writes the 2 * n hex digits of src[0, n) to dst
+  static void encodeHex(const unsigned char *src, size_t n, char *dst) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i wide_nibble_mask = _mm256_set1_epi8(0x0F);
+    for (; i + 32 <= n; i += 32) {
+      __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+      __m256i high = hexDigits(_mm256_and_si256(_mm256_srli_epi16(bytes, 4), wide_nibble_mask));
+      __m256i low = hexDigits(_mm256_and_si256(bytes, wide_nibble_mask));
+      // the unpacks interleave within 128-bit lanes, put the lanes back in order
+      __m256i first = _mm256_unpacklo_epi8(high, low);
+      __m256i second = _mm256_unpackhi_epi8(high, low);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * i + 32),
+                          _mm256_permute2x128_si256(first, second, 0x31));
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    for (; i + 16 <= n; i += 16) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      __m128i high = hexDigits(_mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask));
+      __m128i low = hexDigits(_mm_and_si128(bytes, nibble_mask));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), _mm_unpacklo_epi8(high, low));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+#endif
+    static const char digits[] = "0123456789ABCDEF";
+    for (; i < n; i++) {
+      dst[2 * i] = digits[src[i] >> 4];
+      dst[2 * i + 1] = digits[src[i] & 0x0F];
+    }
+  }
+
+private:
+  // the buffers not yet destroyed, most recent first
+  static OutputBuffer *&live() {
+    static OutputBuffer *head = nullptr;
+    return head;
+  }
+
+#if defined(__AVX2__)
+  // '0' + nibble, plus 7 more to reach 'A' for nibbles above 9
+  static __m256i hexDigits(__m256i nibbles) {
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)), _mm256_set1_epi8(7));
+    return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+  }
+#endif
+#if defined(__SSE2__)
+  static __m128i hexDigits(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8(7));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+  }
+#endif
+
+  bool drain() {
+    size_t n = size_;
+    size_ = 0;
+    return writeAll(buffer_.data(), n);
+  }
+
+  bool writeAll(const char *p, size_t n) {
+    while (n > 0) {
+      ssize_t written = ::write(fd_, p, n);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      p += written;
+      n -= written;
+    }
+    return true;
+  }
+
+  int fd_;
+  std::vector<char> buffer_;
+  size_t size_;
+  OutputBuffer *next_;
+};
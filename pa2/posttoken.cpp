@@ -1,58 +1,74 @@
 // (C) 2013 CPPGM Foundation www.cppgm.org.  All rights reserved.
 
 #include <iostream>
-#include <sstream>
 #include <fstream>
 #include <stdexcept>
 #include <algorithm>
-#include <unordered_map>
 #include <unordered_set>
 #include <cassert>
 #include <memory>
 #include <cstring>
 #include <cstdint>
 #include <climits>
-#include <map>
+#include <limits>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "DebugPPTokenStream.h"
+#include "DecimalToBinary.h"
+#include "OutputBuffer.h"
+#include "Utf8Decoder.h"
 
 using namespace std;
 
 // See 3.9.1: Fundamental Types
+// X(enumerator, source code name) for each fundamental type
+#define FUNDAMENTAL_TYPES(X) \
+  /* 3.9.1.2 */                                          \
+  X(FT_SIGNED_CHAR, "signed char")                       \
+  X(FT_SHORT_INT, "short int")                           \
+  X(FT_INT, "int")                                       \
+  X(FT_LONG_INT, "long int")                             \
+  X(FT_LONG_LONG_INT, "long long int")                   \
+                                                         \
+  /* 3.9.1.3 */                                          \
+  X(FT_UNSIGNED_CHAR, "unsigned char")                   \
+  X(FT_UNSIGNED_SHORT_INT, "unsigned short int")         \
+  X(FT_UNSIGNED_INT, "unsigned int")                     \
+  X(FT_UNSIGNED_LONG_INT, "unsigned long int")           \
+  X(FT_UNSIGNED_LONG_LONG_INT, "unsigned long long int") \
+                                                         \
+  /* 3.9.1.1 / 3.9.1.5 */                                \
+  X(FT_WCHAR_T, "wchar_t")                               \
+  X(FT_CHAR, "char")                                     \
+  X(FT_CHAR16_T, "char16_t")                             \
+  X(FT_CHAR32_T, "char32_t")                             \
+                                                         \
+  /* 3.9.1.6 */                                          \
+  X(FT_BOOL, "bool")                                     \
+                                                         \
+  /* 3.9.1.8 */                                          \
+  X(FT_FLOAT, "float")                                   \
+  X(FT_DOUBLE, "double")                                 \
+  X(FT_LONG_DOUBLE, "long double")                       \
+                                                         \
+  /* 3.9.1.9 */                                          \
+  X(FT_VOID, "void")                                     \
+                                                         \
+  /* 3.9.1.10 */                                         \
+  X(FT_NULLPTR_T, "nullptr_t")
+
 enum EFundamentalType {
-  // 3.9.1.2
-    FT_SIGNED_CHAR,
-  FT_SHORT_INT,
-  FT_INT,
-  FT_LONG_INT,
-  FT_LONG_LONG_INT,
-
-  // 3.9.1.3
-    FT_UNSIGNED_CHAR,
-  FT_UNSIGNED_SHORT_INT,
-  FT_UNSIGNED_INT,
-  FT_UNSIGNED_LONG_INT,
-  FT_UNSIGNED_LONG_LONG_INT,
-
-  // 3.9.1.1 / 3.9.1.5
-    FT_WCHAR_T,
-  FT_CHAR,
-  FT_CHAR16_T,
-  FT_CHAR32_T,
-
-  // 3.9.1.6
-    FT_BOOL,
-
-  // 3.9.1.8
-    FT_FLOAT,
-  FT_DOUBLE,
-  FT_LONG_DOUBLE,
-
-  // 3.9.1.9
-    FT_VOID,
-
-  // 3.9.1.10
-    FT_NULLPTR_T
+#define FUNDAMENTAL_TYPE_ENUMERATOR(type, name) type,
+  FUNDAMENTAL_TYPES(FUNDAMENTAL_TYPE_ENUMERATOR)
+#undef FUNDAMENTAL_TYPE_ENUMERATOR
 };
 
 // FundamentalTypeOf: convert fundamental type T to EFundamentalType
@@ -121,161 +137,153 @@ template<>
 constexpr EFundamentalType FundamentalTypeOf<nullptr_t>() { return FT_NULLPTR_T; }
 
 // convert EFundamentalType to a source code
-const map<EFundamentalType, string> FundamentalTypeToStringMap
-  {
-    {FT_SIGNED_CHAR,            "signed char"},
-    {FT_SHORT_INT,              "short int"},
-    {FT_INT,                    "int"},
-    {FT_LONG_INT,               "long int"},
-    {FT_LONG_LONG_INT,          "long long int"},
-    {FT_UNSIGNED_CHAR,          "unsigned char"},
-    {FT_UNSIGNED_SHORT_INT,     "unsigned short int"},
-    {FT_UNSIGNED_INT,           "unsigned int"},
-    {FT_UNSIGNED_LONG_INT,      "unsigned long int"},
-    {FT_UNSIGNED_LONG_LONG_INT, "unsigned long long int"},
-    {FT_WCHAR_T,                "wchar_t"},
-    {FT_CHAR,                   "char"},
-    {FT_CHAR16_T,               "char16_t"},
-    {FT_CHAR32_T,               "char32_t"},
-    {FT_BOOL,                   "bool"},
-    {FT_FLOAT,                  "float"},
-    {FT_DOUBLE,                 "double"},
-    {FT_LONG_DOUBLE,            "long double"},
-    {FT_VOID,                   "void"},
-    {FT_NULLPTR_T,              "nullptr_t"}
-  };
+constexpr const char *FundamentalTypeToStringMap[] = {
+#define FUNDAMENTAL_TYPE_NAME(type, name) name,
+  FUNDAMENTAL_TYPES(FUNDAMENTAL_TYPE_NAME)
+#undef FUNDAMENTAL_TYPE_NAME
+};
+
+// token type enum for `simples`, X(enumerator) for each
+#define TOKEN_TYPES(X) \
+  /* keywords */              \
+  X(KW_ALIGNAS)               \
+  X(KW_ALIGNOF)               \
+  X(KW_ASM)                   \
+  X(KW_AUTO)                  \
+  X(KW_BOOL)                  \
+  X(KW_BREAK)                 \
+  X(KW_CASE)                  \
+  X(KW_CATCH)                 \
+  X(KW_CHAR)                  \
+  X(KW_CHAR16_T)              \
+  X(KW_CHAR32_T)              \
+  X(KW_CLASS)                 \
+  X(KW_CONST)                 \
+  X(KW_CONSTEXPR)             \
+  X(KW_CONST_CAST)            \
+  X(KW_CONTINUE)              \
+  X(KW_DECLTYPE)              \
+  X(KW_DEFAULT)               \
+  X(KW_DELETE)                \
+  X(KW_DO)                    \
+  X(KW_DOUBLE)                \
+  X(KW_DYNAMIC_CAST)          \
+  X(KW_ELSE)                  \
+  X(KW_ENUM)                  \
+  X(KW_EXPLICIT)              \
+  X(KW_EXPORT)                \
+  X(KW_EXTERN)                \
+  X(KW_FALSE)                 \
+  X(KW_FLOAT)                 \
+  X(KW_FOR)                   \
+  X(KW_FRIEND)                \
+  X(KW_GOTO)                  \
+  X(KW_IF)                    \
+  X(KW_INLINE)                \
+  X(KW_INT)                   \
+  X(KW_LONG)                  \
+  X(KW_MUTABLE)               \
+  X(KW_NAMESPACE)             \
+  X(KW_NEW)                   \
+  X(KW_NOEXCEPT)              \
+  X(KW_NULLPTR)               \
+  X(KW_OPERATOR)              \
+  X(KW_PRIVATE)               \
+  X(KW_PROTECTED)             \
+  X(KW_PUBLIC)                \
+  X(KW_REGISTER)              \
+  X(KW_REINTERPET_CAST)       \
+  X(KW_RETURN)                \
+  X(KW_SHORT)                 \
+  X(KW_SIGNED)                \
+  X(KW_SIZEOF)                \
+  X(KW_STATIC)                \
+  X(KW_STATIC_ASSERT)         \
+  X(KW_STATIC_CAST)           \
+  X(KW_STRUCT)                \
+  X(KW_SWITCH)                \
+  X(KW_TEMPLATE)              \
+  X(KW_THIS)                  \
+  X(KW_THREAD_LOCAL)          \
+  X(KW_THROW)                 \
+  X(KW_TRUE)                  \
+  X(KW_TRY)                   \
+  X(KW_TYPEDEF)               \
+  X(KW_TYPEID)                \
+  X(KW_TYPENAME)              \
+  X(KW_UNION)                 \
+  X(KW_UNSIGNED)              \
+  X(KW_USING)                 \
+  X(KW_VIRTUAL)               \
+  X(KW_VOID)                  \
+  X(KW_VOLATILE)              \
+  X(KW_WCHAR_T)               \
+  X(KW_WHILE)                 \
+                              \
+  /* operators/punctuation */ \
+  X(OP_LBRACE)                \
+  X(OP_RBRACE)                \
+  X(OP_LSQUARE)               \
+  X(OP_RSQUARE)               \
+  X(OP_LPAREN)                \
+  X(OP_RPAREN)                \
+  X(OP_BOR)                   \
+  X(OP_XOR)                   \
+  X(OP_COMPL)                 \
+  X(OP_AMP)                   \
+  X(OP_LNOT)                  \
+  X(OP_SEMICOLON)             \
+  X(OP_COLON)                 \
+  X(OP_DOTS)                  \
+  X(OP_QMARK)                 \
+  X(OP_COLON2)                \
+  X(OP_DOT)                   \
+  X(OP_DOTSTAR)               \
+  X(OP_PLUS)                  \
+  X(OP_MINUS)                 \
+  X(OP_STAR)                  \
+  X(OP_DIV)                   \
+  X(OP_MOD)                   \
+  X(OP_ASS)                   \
+  X(OP_LT)                    \
+  X(OP_GT)                    \
+  X(OP_PLUSASS)               \
+  X(OP_MINUSASS)              \
+  X(OP_STARASS)               \
+  X(OP_DIVASS)                \
+  X(OP_MODASS)                \
+  X(OP_XORASS)                \
+  X(OP_BANDASS)               \
+  X(OP_BORASS)                \
+  X(OP_LSHIFT)                \
+  X(OP_RSHIFT)                \
+  X(OP_RSHIFTASS)             \
+  X(OP_LSHIFTASS)             \
+  X(OP_EQ)                    \
+  X(OP_NE)                    \
+  X(OP_LE)                    \
+  X(OP_GE)                    \
+  X(OP_LAND)                  \
+  X(OP_LOR)                   \
+  X(OP_INC)                   \
+  X(OP_DEC)                   \
+  X(OP_COMMA)                 \
+  X(OP_ARROWSTAR)             \
+  X(OP_ARROW)
 
-// token type enum for `simples`
 enum ETokenType {
-  // keywords
-    KW_ALIGNAS,
-  KW_ALIGNOF,
-  KW_ASM,
-  KW_AUTO,
-  KW_BOOL,
-  KW_BREAK,
-  KW_CASE,
-  KW_CATCH,
-  KW_CHAR,
-  KW_CHAR16_T,
-  KW_CHAR32_T,
-  KW_CLASS,
-  KW_CONST,
-  KW_CONSTEXPR,
-  KW_CONST_CAST,
-  KW_CONTINUE,
-  KW_DECLTYPE,
-  KW_DEFAULT,
-  KW_DELETE,
-  KW_DO,
-  KW_DOUBLE,
-  KW_DYNAMIC_CAST,
-  KW_ELSE,
-  KW_ENUM,
-  KW_EXPLICIT,
-  KW_EXPORT,
-  KW_EXTERN,
-  KW_FALSE,
-  KW_FLOAT,
-  KW_FOR,
-  KW_FRIEND,
-  KW_GOTO,
-  KW_IF,
-  KW_INLINE,
-  KW_INT,
-  KW_LONG,
-  KW_MUTABLE,
-  KW_NAMESPACE,
-  KW_NEW,
-  KW_NOEXCEPT,
-  KW_NULLPTR,
-  KW_OPERATOR,
-  KW_PRIVATE,
-  KW_PROTECTED,
-  KW_PUBLIC,
-  KW_REGISTER,
-  KW_REINTERPET_CAST,
-  KW_RETURN,
-  KW_SHORT,
-  KW_SIGNED,
-  KW_SIZEOF,
-  KW_STATIC,
-  KW_STATIC_ASSERT,
-  KW_STATIC_CAST,
-  KW_STRUCT,
-  KW_SWITCH,
-  KW_TEMPLATE,
-  KW_THIS,
-  KW_THREAD_LOCAL,
-  KW_THROW,
-  KW_TRUE,
-  KW_TRY,
-  KW_TYPEDEF,
-  KW_TYPEID,
-  KW_TYPENAME,
-  KW_UNION,
-  KW_UNSIGNED,
-  KW_USING,
-  KW_VIRTUAL,
-  KW_VOID,
-  KW_VOLATILE,
-  KW_WCHAR_T,
-  KW_WHILE,
-
-  // operators/punctuation
-    OP_LBRACE,
-  OP_RBRACE,
-  OP_LSQUARE,
-  OP_RSQUARE,
-  OP_LPAREN,
-  OP_RPAREN,
-  OP_BOR,
-  OP_XOR,
-  OP_COMPL,
-  OP_AMP,
-  OP_LNOT,
-  OP_SEMICOLON,
-  OP_COLON,
-  OP_DOTS,
-  OP_QMARK,
-  OP_COLON2,
-  OP_DOT,
-  OP_DOTSTAR,
-  OP_PLUS,
-  OP_MINUS,
-  OP_STAR,
-  OP_DIV,
-  OP_MOD,
-  OP_ASS,
-  OP_LT,
-  OP_GT,
-  OP_PLUSASS,
-  OP_MINUSASS,
-  OP_STARASS,
-  OP_DIVASS,
-  OP_MODASS,
-  OP_XORASS,
-  OP_BANDASS,
-  OP_BORASS,
-  OP_LSHIFT,
-  OP_RSHIFT,
-  OP_RSHIFTASS,
-  OP_LSHIFTASS,
-  OP_EQ,
-  OP_NE,
-  OP_LE,
-  OP_GE,
-  OP_LAND,
-  OP_LOR,
-  OP_INC,
-  OP_DEC,
-  OP_COMMA,
-  OP_ARROWSTAR,
-  OP_ARROW,
+#define TOKEN_TYPE_ENUMERATOR(type) type,
+  TOKEN_TYPES(TOKEN_TYPE_ENUMERATOR)
+#undef TOKEN_TYPE_ENUMERATOR
+};
+
+// `simple` `preprocessing-tokens` and their ETokenType
+struct SimpleToken {
+  const char *spelling;
+  ETokenType type;
 };
 
-// StringToETokenTypeMap map of `simple` `preprocessing-tokens` to ETokenType
-const unordered_map<string, ETokenType> StringToTokenTypeMap =
+static constexpr SimpleToken SimpleTokens[] =
   {
     // keywords
     {"alignas",          KW_ALIGNAS},
@@ -419,148 +427,129 @@ const unordered_map<string, ETokenType> StringToTokenTypeMap =
     {"->",               OP_ARROW}
   };
 
-// map of enum to string
-const map<ETokenType, string> TokenTypeToStringMap =
-  {
-    {KW_ALIGNAS,         "KW_ALIGNAS"},
-    {KW_ALIGNOF,         "KW_ALIGNOF"},
-    {KW_ASM,             "KW_ASM"},
-    {KW_AUTO,            "KW_AUTO"},
-    {KW_BOOL,            "KW_BOOL"},
-    {KW_BREAK,           "KW_BREAK"},
-    {KW_CASE,            "KW_CASE"},
-    {KW_CATCH,           "KW_CATCH"},
-    {KW_CHAR,            "KW_CHAR"},
-    {KW_CHAR16_T,        "KW_CHAR16_T"},
-    {KW_CHAR32_T,        "KW_CHAR32_T"},
-    {KW_CLASS,           "KW_CLASS"},
-    {KW_CONST,           "KW_CONST"},
-    {KW_CONSTEXPR,       "KW_CONSTEXPR"},
-    {KW_CONST_CAST,      "KW_CONST_CAST"},
-    {KW_CONTINUE,        "KW_CONTINUE"},
-    {KW_DECLTYPE,        "KW_DECLTYPE"},
-    {KW_DEFAULT,         "KW_DEFAULT"},
-    {KW_DELETE,          "KW_DELETE"},
-    {KW_DO,              "KW_DO"},
-    {KW_DOUBLE,          "KW_DOUBLE"},
-    {KW_DYNAMIC_CAST,    "KW_DYNAMIC_CAST"},
-    {KW_ELSE,            "KW_ELSE"},
-    {KW_ENUM,            "KW_ENUM"},
-    {KW_EXPLICIT,        "KW_EXPLICIT"},
-    {KW_EXPORT,          "KW_EXPORT"},
-    {KW_EXTERN,          "KW_EXTERN"},
-    {KW_FALSE,           "KW_FALSE"},
-    {KW_FLOAT,           "KW_FLOAT"},
-    {KW_FOR,             "KW_FOR"},
-    {KW_FRIEND,          "KW_FRIEND"},
-    {KW_GOTO,            "KW_GOTO"},
-    {KW_IF,              "KW_IF"},
-    {KW_INLINE,          "KW_INLINE"},
-    {KW_INT,             "KW_INT"},
-    {KW_LONG,            "KW_LONG"},
-    {KW_MUTABLE,         "KW_MUTABLE"},
-    {KW_NAMESPACE,       "KW_NAMESPACE"},
-    {KW_NEW,             "KW_NEW"},
-    {KW_NOEXCEPT,        "KW_NOEXCEPT"},
-    {KW_NULLPTR,         "KW_NULLPTR"},
-    {KW_OPERATOR,        "KW_OPERATOR"},
-    {KW_PRIVATE,         "KW_PRIVATE"},
-    {KW_PROTECTED,       "KW_PROTECTED"},
-    {KW_PUBLIC,          "KW_PUBLIC"},
-    {KW_REGISTER,        "KW_REGISTER"},
-    {KW_REINTERPET_CAST, "KW_REINTERPET_CAST"},
-    {KW_RETURN,          "KW_RETURN"},
-    {KW_SHORT,           "KW_SHORT"},
-    {KW_SIGNED,          "KW_SIGNED"},
-    {KW_SIZEOF,          "KW_SIZEOF"},
-    {KW_STATIC,          "KW_STATIC"},
-    {KW_STATIC_ASSERT,   "KW_STATIC_ASSERT"},
-    {KW_STATIC_CAST,     "KW_STATIC_CAST"},
-    {KW_STRUCT,          "KW_STRUCT"},
-    {KW_SWITCH,          "KW_SWITCH"},
-    {KW_TEMPLATE,        "KW_TEMPLATE"},
-    {KW_THIS,            "KW_THIS"},
-    {KW_THREAD_LOCAL,    "KW_THREAD_LOCAL"},
-    {KW_THROW,           "KW_THROW"},
-    {KW_TRUE,            "KW_TRUE"},
-    {KW_TRY,             "KW_TRY"},
-    {KW_TYPEDEF,         "KW_TYPEDEF"},
-    {KW_TYPEID,          "KW_TYPEID"},
-    {KW_TYPENAME,        "KW_TYPENAME"},
-    {KW_UNION,           "KW_UNION"},
-    {KW_UNSIGNED,        "KW_UNSIGNED"},
-    {KW_USING,           "KW_USING"},
-    {KW_VIRTUAL,         "KW_VIRTUAL"},
-    {KW_VOID,            "KW_VOID"},
-    {KW_VOLATILE,        "KW_VOLATILE"},
-    {KW_WCHAR_T,         "KW_WCHAR_T"},
-    {KW_WHILE,           "KW_WHILE"},
-    {OP_LBRACE,          "OP_LBRACE"},
-    {OP_RBRACE,          "OP_RBRACE"},
-    {OP_LSQUARE,         "OP_LSQUARE"},
-    {OP_RSQUARE,         "OP_RSQUARE"},
-    {OP_LPAREN,          "OP_LPAREN"},
-    {OP_RPAREN,          "OP_RPAREN"},
-    {OP_BOR,             "OP_BOR"},
-    {OP_XOR,             "OP_XOR"},
-    {OP_COMPL,           "OP_COMPL"},
-    {OP_AMP,             "OP_AMP"},
-    {OP_LNOT,            "OP_LNOT"},
-    {OP_SEMICOLON,       "OP_SEMICOLON"},
-    {OP_COLON,           "OP_COLON"},
-    {OP_DOTS,            "OP_DOTS"},
-    {OP_QMARK,           "OP_QMARK"},
-    {OP_COLON2,          "OP_COLON2"},
-    {OP_DOT,             "OP_DOT"},
-    {OP_DOTSTAR,         "OP_DOTSTAR"},
-    {OP_PLUS,            "OP_PLUS"},
-    {OP_MINUS,           "OP_MINUS"},
-    {OP_STAR,            "OP_STAR"},
-    {OP_DIV,             "OP_DIV"},
-    {OP_MOD,             "OP_MOD"},
-    {OP_ASS,             "OP_ASS"},
-    {OP_LT,              "OP_LT"},
-    {OP_GT,              "OP_GT"},
-    {OP_PLUSASS,         "OP_PLUSASS"},
-    {OP_MINUSASS,        "OP_MINUSASS"},
-    {OP_STARASS,         "OP_STARASS"},
-    {OP_DIVASS,          "OP_DIVASS"},
-    {OP_MODASS,          "OP_MODASS"},
-    {OP_XORASS,          "OP_XORASS"},
-    {OP_BANDASS,         "OP_BANDASS"},
-    {OP_BORASS,          "OP_BORASS"},
-    {OP_LSHIFT,          "OP_LSHIFT"},
-    {OP_RSHIFT,          "OP_RSHIFT"},
-    {OP_RSHIFTASS,       "OP_RSHIFTASS"},
-    {OP_LSHIFTASS,       "OP_LSHIFTASS"},
-    {OP_EQ,              "OP_EQ"},
-    {OP_NE,              "OP_NE"},
-    {OP_LE,              "OP_LE"},
-    {OP_GE,              "OP_GE"},
-    {OP_LAND,            "OP_LAND"},
-    {OP_LOR,             "OP_LOR"},
-    {OP_INC,             "OP_INC"},
-    {OP_DEC,             "OP_DEC"},
-    {OP_COMMA,           "OP_COMMA"},
-    {OP_ARROWSTAR,       "OP_ARROWSTAR"},
-    {OP_ARROW,           "OP_ARROW"}
-  };
+static constexpr size_t SimpleTokenCount = sizeof SimpleTokens / sizeof SimpleTokens[0];
+
+// perfect hash over SimpleTokens: a multiplicative hash of the length and
+// four characters sends every simple token to its own slot, so a lookup
+// is one hash and at most one string compare
+struct SimpleTokenHash {
+  static constexpr int HashBits = 10;
+  static constexpr uint64_t HashMultiplier = 0x2b17cd2cb58b010fULL;
+  static constexpr size_t MaxLength = 16;
+
+  static constexpr size_t length(const char *s) {
+    return *s == '\0' ? 0 : 1 + length(s + 1);
+  }
+
+  static constexpr size_t hash(const char *s, size_t n) {
+    return size_t(((n | uint64_t(uint8_t(s[0])) << 8 | uint64_t(uint8_t(s[n > 1 ? 1 : 0])) << 16 |
+                    uint64_t(uint8_t(s[n / 2])) << 24 | uint64_t(uint8_t(s[n - 1])) << 32) *
+                   HashMultiplier) >> (64 - HashBits));
+  }
+
+  static constexpr size_t hashOf(size_t i) {
+    return hash(SimpleTokens[i].spelling, length(SimpleTokens[i].spelling));
+  }
+
+  // index + 1 into SimpleTokens of the token in slot, 0 for an empty slot
+  static constexpr uint8_t slotOf(size_t slot, size_t i = 0) {
+    return i == SimpleTokenCount ? 0 : hashOf(i) == slot ? uint8_t(i + 1) : slotOf(slot, i + 1);
+  }
+
+  // whether no token after i shares its slot
+  static constexpr bool isAlone(size_t i, size_t j) {
+    return j == SimpleTokenCount || (hashOf(i) != hashOf(j) && isAlone(i, j + 1));
+  }
+
+  static constexpr bool isPerfect(size_t i = 0) {
+    return i == SimpleTokenCount ||
+      (length(SimpleTokens[i].spelling) <= MaxLength && isAlone(i, i + 1) && isPerfect(i + 1));
+  }
+};
+
+static_assert(SimpleTokenHash::isPerfect(),
+              "HashMultiplier is no longer a perfect hash of SimpleTokens, or one is longer than MaxLength");
+
+#define SIMPLE_TOKEN_SLOTS_16(i) \
+  SimpleTokenHash::slotOf(i + 0x0), SimpleTokenHash::slotOf(i + 0x1), SimpleTokenHash::slotOf(i + 0x2), \
+  SimpleTokenHash::slotOf(i + 0x3), SimpleTokenHash::slotOf(i + 0x4), SimpleTokenHash::slotOf(i + 0x5), \
+  SimpleTokenHash::slotOf(i + 0x6), SimpleTokenHash::slotOf(i + 0x7), SimpleTokenHash::slotOf(i + 0x8), \
+  SimpleTokenHash::slotOf(i + 0x9), SimpleTokenHash::slotOf(i + 0xA), SimpleTokenHash::slotOf(i + 0xB), \
+  SimpleTokenHash::slotOf(i + 0xC), SimpleTokenHash::slotOf(i + 0xD), SimpleTokenHash::slotOf(i + 0xE), \
+  SimpleTokenHash::slotOf(i + 0xF)
 
-const unordered_map<char, char> SimpleEscapeSequenceMap =
+#define SIMPLE_TOKEN_SLOTS_128(i) \
+  SIMPLE_TOKEN_SLOTS_16(i + 0x00), SIMPLE_TOKEN_SLOTS_16(i + 0x10), SIMPLE_TOKEN_SLOTS_16(i + 0x20), \
+  SIMPLE_TOKEN_SLOTS_16(i + 0x30), SIMPLE_TOKEN_SLOTS_16(i + 0x40), SIMPLE_TOKEN_SLOTS_16(i + 0x50), \
+  SIMPLE_TOKEN_SLOTS_16(i + 0x60), SIMPLE_TOKEN_SLOTS_16(i + 0x70)
+
+static constexpr uint8_t SimpleTokenSlots[1 << SimpleTokenHash::HashBits] =
   {
-    {'\'', '\''},
-    {'"',  '\"'},
-    {'?',  '\?'},
-    {'\\', '\\'},
-    {'a',  '\a'},
-    {'b',  '\b'},
-    {'f',  '\f'},
-    {'n',  '\n'},
-    {'r',  '\r'},
-    {'t',  '\t'},
-    {'v',  '\v'},
+    SIMPLE_TOKEN_SLOTS_128(0x000),
+    SIMPLE_TOKEN_SLOTS_128(0x080),
+    SIMPLE_TOKEN_SLOTS_128(0x100),
+    SIMPLE_TOKEN_SLOTS_128(0x180),
+    SIMPLE_TOKEN_SLOTS_128(0x200),
+    SIMPLE_TOKEN_SLOTS_128(0x280),
+    SIMPLE_TOKEN_SLOTS_128(0x300),
+    SIMPLE_TOKEN_SLOTS_128(0x380)
   };
 
+#undef SIMPLE_TOKEN_SLOTS_128
+#undef SIMPLE_TOKEN_SLOTS_16
+
+// false if str is not a simple token
+static bool findSimpleToken(const string &str, ETokenType &type) {
+  size_t n = str.size();
+  if (n == 0 || n > SimpleTokenHash::MaxLength) {
+    return false;
+  }
+  uint8_t slot = SimpleTokenSlots[SimpleTokenHash::hash(str.data(), n)];
+  if (slot == 0) {
+    return false;
+  }
+  const SimpleToken &token = SimpleTokens[slot - 1];
+  if (strncmp(token.spelling, str.data(), n) != 0 || token.spelling[n] != '\0') {
+    return false;
+  }
+  type = token.type;
+  return true;
+}
+
+// map of enum to string
+constexpr const char *TokenTypeToStringMap[] = {
+#define TOKEN_TYPE_NAME(type) #type,
+  TOKEN_TYPES(TOKEN_TYPE_NAME)
+#undef TOKEN_TYPE_NAME
+};
+
+// value of the simple-escape-sequence \c, 0 if c does not form one
+static char SimpleEscapeValue(char c) {
+  switch (c) {
+    case '\'':
+    case '"':
+    case '?':
+    case '\\':
+      return c;
+    case 'a':
+      return '\a';
+    case 'b':
+      return '\b';
+    case 'f':
+      return '\f';
+    case 'n':
+      return '\n';
+    case 'r':
+      return '\r';
+    case 't':
+      return '\t';
+    case 'v':
+      return '\v';
+    default:
+      return 0;
+  }
+}
+
 // given hex digit character c, return its flag
 static int HexCharToValue(int c) {
   switch (c) {
@@ -613,143 +602,90 @@ static int HexCharToValue(int c) {
   }
 }
 
-// convert integer [0,15] to hexadecimal digit
-static char ValueToHexChar(int c) {
-  switch (c) {
-    case 0:
-      return '0';
-    case 1:
-      return '1';
-    case 2:
-      return '2';
-    case 3:
-      return '3';
-    case 4:
-      return '4';
-    case 5:
-      return '5';
-    case 6:
-      return '6';
-    case 7:
-      return '7';
-    case 8:
-      return '8';
-    case 9:
-      return '9';
-    case 10:
-      return 'A';
-    case 11:
-      return 'B';
-    case 12:
-      return 'C';
-    case 13:
-      return 'D';
-    case 14:
-      return 'E';
-    case 15:
-      return 'F';
-    default:
-      throw logic_error("ValueToHexChar of nonhex flag");
-  }
-}
-
-// hex dump memory range
-string HexDump(const void *pdata, size_t nbytes) {
-  unsigned char *p = (unsigned char *) pdata;
-
-  string s(nbytes *
-           2, '?');
-
-  for (size_t i = 0; i < nbytes; i++) {
-    s[2 * i + 0] = ValueToHexChar((p[i] & 0xF0) >> 4);
-    s[2 * i + 1] = ValueToHexChar((p[i] & 0x0F) >> 0);
-  }
-
-  return s;
+// hex dump memory range, encoded straight into the output buffer
+HexBytes HexDump(const void *pdata, size_t nbytes) {
+  return HexBytes{pdata, nbytes};
 }
 
 // DebugPostTokenOutputStream: helper class to produce PA2 output format
 struct DebugPostTokenOutputStream {
+  DebugPostTokenOutputStream() : out(STDOUT_FILENO) {}
+
   // output: invalid <source>
   void emit_invalid(const string &source) {
-    cout << "invalid " << source << endl;
+    out << "invalid " << source << '\n';
   }
 
   // output: simple <source> <token_type>
   void emit_simple(const string &source, ETokenType token_type) {
-    cout << "simple " << source << " " << TokenTypeToStringMap.at(token_type) << endl;
+    out << "simple " << source << " " << TokenTypeToStringMap[token_type] << '\n';
   }
 
   // output: identifier <source>
   void emit_identifier(const string &source) {
-    cout << "identifier " << source << endl;
+    out << "identifier " << source << '\n';
   }
 
   // output: literal <source> <type> <hexdump(data,nbytes)>
   void emit_literal(const string &source, EFundamentalType type, const void *data, size_t nbytes) {
-    cout << "literal " << source << " " << FundamentalTypeToStringMap.at(type) << " " << HexDump(data, nbytes)
-         << endl;
+    out << "literal " << source << " " << FundamentalTypeToStringMap[type] << " " << HexDump(data, nbytes)
+         << '\n';
   }
 
   // output: literal <source> array of <num_elements> <type> <hexdump(data,nbytes)>
   void emit_literal_array(const string &source, size_t num_elements, EFundamentalType type, const void *data,
                           size_t nbytes) {
-    cout << "literal " << source << " array of " << num_elements << " " << FundamentalTypeToStringMap.at(type) << " "
-         << HexDump(data, nbytes) << endl;
+    out << "literal " << source << " array of " << num_elements << " " << FundamentalTypeToStringMap[type] << " "
+         << HexDump(data, nbytes) << '\n';
   }
 
   // output: user-defined-literal <source> <ud_suffix> character <type> <hexdump(data,nbytes)>
   void emit_user_defined_literal_character(const string &source, const string &ud_suffix, EFundamentalType type,
                                            const void *data, size_t nbytes) {
-    cout << "user-defined-literal " << source << " " << ud_suffix << " character "
-         << FundamentalTypeToStringMap.at(type) << " " << HexDump(data, nbytes) << endl;
+    out << "user-defined-literal " << source << " " << ud_suffix << " character "
+         << FundamentalTypeToStringMap[type] << " " << HexDump(data, nbytes) << '\n';
   }
 
   // output: user-defined-literal <source> <ud_suffix> string array of <num_elements> <type> <hexdump(data, nbytes)>
   void emit_user_defined_literal_string_array(const string &source, const string &ud_suffix, size_t num_elements,
                                               EFundamentalType type, const void *data, size_t nbytes) {
-    cout << "user-defined-literal " << source << " " << ud_suffix << " string array of " << num_elements << " "
-         << FundamentalTypeToStringMap.at(type) << " " << HexDump(data, nbytes) << endl;
+    out << "user-defined-literal " << source << " " << ud_suffix << " string array of " << num_elements << " "
+         << FundamentalTypeToStringMap[type] << " " << HexDump(data, nbytes) << '\n';
   }
 
   // output: user-defined-literal <source> <ud_suffix> <prefix>
   void emit_user_defined_literal_integer(const string &source, const string &ud_suffix, const string &prefix) {
-    cout << "user-defined-literal " << source << " " << ud_suffix << " integer " << prefix << endl;
+    out << "user-defined-literal " << source << " " << ud_suffix << " integer " << prefix << '\n';
   }
 
   // output: user-defined-literal <source> <ud_suffix> <prefix>
   void emit_user_defined_literal_floating(const string &source, const string &ud_suffix, const string &prefix) {
-    cout << "user-defined-literal " << source << " " << ud_suffix << " floating " << prefix << endl;
+    out << "user-defined-literal " << source << " " << ud_suffix << " floating " << prefix << '\n';
   }
 
   // output : eof
   void emit_eof() {
-    cout << "eof" << endl;
+    out << "eof" << '\n';
+    out.flush();
   }
+
+private:
+  OutputBuffer out;
 };
 
 
 // use these 3 functions to scan `floating-literals` (see PA2)
 // for example PA2Decode_float("12.34") returns "12.34" as a `float` type
 float PA2Decode_float(const string &s) {
-  istringstream iss(s);
-  float x;
-  iss >> x;
-  return x;
+  return decodeDecimal<float>(s);
 }
 
 double PA2Decode_double(const string &s) {
-  istringstream iss(s);
-  double x;
-  iss >> x;
-  return x;
+  return decodeDecimal<double>(s);
 }
 
 long double PA2Decode_long_double(const string &s) {
-  istringstream iss(s);
-  long double x;
-  iss >> x;
-  return x;
+  return decodeDecimal<long double>(s);
 }
 
 static inline bool isInvalidOperator(const string &data) {
@@ -760,72 +696,71 @@ static inline bool isHex(char c) {
   return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
 }
 
-static inline void strPush(string &str, uint16_t val) {
-  str.push_back((char) (val & 0xff));
-  str.push_back((char) ((val >> 8) & 0xff));
+// little-endian code units at p
+static inline void storeUnit(char *p, uint16_t val) {
+  p[0] = (char) (val & 0xff);
+  p[1] = (char) ((val >> 8) & 0xff);
 }
 
-static inline void strPush(string &str, uint32_t val) {
-  str.push_back((char) (val & 0xff));
-  str.push_back((char) ((val >> 8) & 0xff));
-  str.push_back((char) ((val >> 16) & 0xff));
-  str.push_back((char) ((val >> 24) & 0xff));
+static inline void storeUnit(char *p, uint32_t val) {
+  p[0] = (char) (val & 0xff);
+  p[1] = (char) ((val >> 8) & 0xff);
+  p[2] = (char) ((val >> 16) & 0xff);
+  p[3] = (char) ((val >> 24) & 0xff);
 }
 
-static inline void strPush(string &str, wchar_t val) {
-  str.push_back((char) (val & 0xff));
-  str.push_back((char) ((val >> 8) & 0xff));
-  str.push_back((char) ((val >> 16) & 0xff));
-  str.push_back((char) ((val >> 24) & 0xff));
+// zero-extends the run of ASCII bytes at the start of src[0, n) to 16-bit
+// units at dst and returns its length
+static inline size_t widenAscii16(const char *src, size_t n, char *dst) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    if (_mm_movemask_epi8(bytes) != 0) {
+      break;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), _mm_unpacklo_epi8(bytes, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i + 16), _mm_unpackhi_epi8(bytes, zero));
+  }
+#endif
+  for (; i < n && (unsigned char) src[i] < 0x80; i++) {
+    storeUnit(dst + 2 * i, (uint16_t) src[i]);
+  }
+  return i;
 }
 
-static char32_t string2CodePoint(const string &str, string::size_type &index) {
-
-  char32_t val = 0, t;
-
-  uint8_t arr[] = {0x80, 0xe0, 0xf0, 0xf8};
-  uint8_t target[] = {0x00, 0xc0, 0xe0, 0xf0};
-  int i, width = 0;
-
-  for (i = 0; i < 4; i++) {
-    if ((arr[i] & str[index]) == target[i]) {
-      width = i + 1;
+// as widenAscii16, to 32-bit units
+static inline size_t widenAscii32(const char *src, size_t n, char *dst) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    if (_mm_movemask_epi8(bytes) != 0) {
       break;
     }
+    __m128i low = _mm_unpacklo_epi8(bytes, zero), high = _mm_unpackhi_epi8(bytes, zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i), _mm_unpacklo_epi16(low, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i + 16), _mm_unpackhi_epi16(low, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i + 32), _mm_unpacklo_epi16(high, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i + 48), _mm_unpackhi_epi16(high, zero));
   }
+#endif
+  for (; i < n && (unsigned char) src[i] < 0x80; i++) {
+    storeUnit(dst + 4 * i, (uint32_t) src[i]);
+  }
+  return i;
+}
 
-  ASSERT(width > 0, "string must be valid encoded utf8");
+// tokens only hold UTF-8 that the tokenizer has decoded or encoded itself
+static char32_t string2CodePoint(const string &str, string::size_type &index) {
+  ASSERT((str[index] & 0xc0) != 0x80, "string must be valid encoded utf8");
 
-  switch (width) {
-    case 1:
-      val |= str[index];
-      break;
-    case 2:
-      val |= (str[index + 1] & 0x3f);
-      t = (char32_t) (str[index] & 0x1f);
-      val |= (t << 6);
-      break;
-    case 3:
-      val |= (str[index + 2] & 0x3f);
-      t = (char32_t) (str[index + 1] & 0x3f);
-      val |= (t << 6);
-      t = (char32_t) (str[index] & 0x1f);
-      val |= (t << 12);
-      break;
-    case 4:
-      val |= (str[index + 3] & 0x3f);
-      t = (char32_t) (str[index + 2] & 0x3f);
-      val |= (t << 6);
-      t = (char32_t) (str[index + 1] & 0x3f);
-      val |= (t << 12);
-      t = (char32_t) (str[index] & 0x07);
-      val |= (t << 18);
-      break;
-    default:
-      ASSERT(false, "never reach here");
-  }
-  index += width;
-  return val;
+  const char *p = str.data() + index;
+  char32_t code_point = decodeUtf8Unchecked(p);
+  index = p - str.data();
+  return code_point;
 }
 
 static string codePoint2String(int c) {
@@ -862,78 +797,92 @@ static string codePoint2String(int c) {
   return data;
 }
 
-static string utf8To16(const string &str) {
-
+// append the UTF-16 encoding of str to data; ASCII runs are widened a
+// vector at a time, the rest decoded code point by code point
+static void utf8To16(const string &str, string &data) {
   const auto sz = str.size();
   string::size_type index = 0;
   char32_t cp;
   uint16_t u1, u2;
-  string data;
+
+  // every byte yields at most 2 bytes, plus 2 more for a code point cut
+  // short at the end
+  auto begin = data.size();
+  data.resize(begin + 2 * sz + 2);
+  char *out = &data[begin];
 
   while (index < sz) {
+    auto ascii = widenAscii16(str.data() + index, sz - index, out);
+    index += ascii;
+    out += 2 * ascii;
+    if (index >= sz) {
+      break;
+    }
+
     cp = string2CodePoint(str, index);
 
     ASSERT(cp >= 0 && cp < 0x10FFFF, "code point must be no greater than 0x10FFFF");
 
     if (cp < 0x10000) {
       u1 = (uint16_t) cp;
-      strPush(data, u1);
+      storeUnit(out, u1);
+      out += 2;
     } else {
       cp -= 0x10000;
       u1 = 0xD800, u2 = 0xDC00;
       u1 |= (uint16_t) ((cp >> 10) & 0x3ff);
       u2 |= (uint16_t) (cp & 0x3ff);
-      strPush(data, u1);
-      strPush(data, u2);
+      storeUnit(out, u1);
+      storeUnit(out + 2, u2);
+      out += 4;
     }
   }
 
-  return data;
+  data.resize(out - data.data());
 }
 
-static string utf8To32(const string &str) {
-  const auto sz = str.size();
-  string::size_type index = 0;
-  char32_t cp;
-  uint32_t val;
-  string data;
-
-  while (index < sz) {
-    cp = string2CodePoint(str, index);
-    ASSERT(cp >= 0 && cp < 0x10FFFF, "code point must be no greater than 0x10FFFF");
-    val = static_cast<uint32_t>(cp);
-    strPush(data, val);
-  }
-
-  return data;
-}
+// append the UTF-32 encoding of str to data, also used for wchar_t
+static void utf8To32(const string &str, string &data) {
+  static_assert(sizeof(wchar_t) == sizeof(uint32_t), "wchar_t literals are encoded as UTF-32");
 
-static string utf8ToWchar(const string &str) {
   const auto sz = str.size();
   string::size_type index = 0;
   char32_t cp;
-  wchar_t val;
-  string data;
+
+  // every code point takes at least one byte
+  auto begin = data.size();
+  data.resize(begin + 4 * sz);
+  char *out = &data[begin];
 
   while (index < sz) {
+    auto ascii = widenAscii32(str.data() + index, sz - index, out);
+    index += ascii;
+    out += 4 * ascii;
+    if (index >= sz) {
+      break;
+    }
+
     cp = string2CodePoint(str, index);
     ASSERT(cp >= 0 && cp < 0x10FFFF, "code point must be no greater than 0x10FFFF");
-    val = static_cast<wchar_t>(cp);
-    strPush(data, val);
+    storeUnit(out, static_cast<uint32_t>(cp));
+    out += 4;
   }
 
-  return data;
+  data.resize(out - data.data());
 }
 
-static inline bool toUnsignedLongLong(const string &str, int base, unsigned long long &val) {
-  std::size_t pos;
-  try {
-    val = std::stoull(str, &pos, base);
-    if (pos != str.size()) {
+// value of the digits str[begin, end) in base 8, 10 or 16, which
+// checkNumberLiteral has already validated; false on overflow
+static inline bool scanIntegerDigits(const string &str, string::size_type begin, string::size_type end,
+                                     unsigned base, unsigned long long &val) {
+  val = 0;
+  for (auto i = begin; i < end; ++i) {
+    char ch = str[i];
+    unsigned digit = ch <= '9' ? ch - '0' : (ch | 0x20) - 'a' + 10;
+    if (val > (ULLONG_MAX - digit) / base) {
       return false;
     }
-  } catch (std::exception &e) {
-    return false;
+    val = val * base + digit;
   }
   return true;
 }
@@ -946,124 +895,106 @@ struct PostException : public std::runtime_error {
 
 using ULL = unsigned long long;
 
-template<typename T>
-struct fit_into {
-  explicit inline fit_into(unsigned long long val, EFundamentalType &type, size_t &width) {
-    flag = 1;
-    T v = (T) val;
-    auto t = (unsigned long long) v;
-    if (v < 0 || t != val) {
-      flag = 0;
-    } else {
-      type = FundamentalTypeOf<T>();
-      width = sizeof(T);
-    }
-  }
-
-  bool valid() const {
-    return flag != 0;
-  }
-
-private:
-  int flag;
+// integer-suffix of an integer literal, ordered so that the value is
+// 3 * (has u) + (number of l)
+enum EIntegerSuffix {
+  IS_NONE,
+  IS_L,
+  IS_LL,
+  IS_U,
+  IS_UL,
+  IS_ULL,
+  IS_COUNT
 };
 
+// a type an integer literal may have, and the largest value it holds
+struct IntegerCandidate {
+  EFundamentalType type;
+  unsigned long long max;
+  size_t width;
+};
 
-struct fit_checker {
-  fit_checker(unsigned long long v, EFundamentalType &t, size_t &w) : val(v), type(t), width(w) {}
+#define INTEGER_CANDIDATE(T) {FundamentalTypeOf<T>(), (unsigned long long) numeric_limits<T>::max(), sizeof(T)}
 
-  template<typename T>
-  inline bool check() {
-    if (fit_into<T>(val, type, width).valid()) {
-      return true;
-    }
-    return false;
-  }
+// the types tried in order for an integer literal, see 2.14.2 Table 6
+struct IntegerPromotion {
+  IntegerCandidate candidates[6];
+  size_t count;
+};
 
-  unsigned long long val;
-  EFundamentalType &type;
-  size_t &width;
+// indexed by [EIntegerSuffix][isDec]
+static constexpr IntegerPromotion IntegerPromotionTable[IS_COUNT][2] = {
+  // IS_NONE
+  {
+    {{INTEGER_CANDIDATE(int), INTEGER_CANDIDATE(unsigned int), INTEGER_CANDIDATE(long int),
+      INTEGER_CANDIDATE(unsigned long int), INTEGER_CANDIDATE(long long int),
+      INTEGER_CANDIDATE(unsigned long long int)}, 6},
+    {{INTEGER_CANDIDATE(int), INTEGER_CANDIDATE(long int), INTEGER_CANDIDATE(long long int)}, 3},
+  },
+  // IS_L
+  {
+    {{INTEGER_CANDIDATE(long int), INTEGER_CANDIDATE(unsigned long int), INTEGER_CANDIDATE(long long int),
+      INTEGER_CANDIDATE(unsigned long long int)}, 4},
+    {{INTEGER_CANDIDATE(long int), INTEGER_CANDIDATE(long long int)}, 2},
+  },
+  // IS_LL
+  {
+    {{INTEGER_CANDIDATE(long long int), INTEGER_CANDIDATE(unsigned long long int)}, 2},
+    {{INTEGER_CANDIDATE(long long int)}, 1},
+  },
+  // IS_U
+  {
+    {{INTEGER_CANDIDATE(unsigned int), INTEGER_CANDIDATE(unsigned long int),
+      INTEGER_CANDIDATE(unsigned long long int)}, 3},
+    {{INTEGER_CANDIDATE(unsigned int), INTEGER_CANDIDATE(unsigned long int),
+      INTEGER_CANDIDATE(unsigned long long int)}, 3},
+  },
+  // IS_UL
+  {
+    {{INTEGER_CANDIDATE(unsigned long int), INTEGER_CANDIDATE(unsigned long long int)}, 2},
+    {{INTEGER_CANDIDATE(unsigned long int), INTEGER_CANDIDATE(unsigned long long int)}, 2},
+  },
+  // IS_ULL
+  {
+    {{INTEGER_CANDIDATE(unsigned long long int)}, 1},
+    {{INTEGER_CANDIDATE(unsigned long long int)}, 1},
+  },
 };
 
+#undef INTEGER_CANDIDATE
 
-void type_climb(bool hasU, bool hasL, bool hasLL, bool isDec,
+// false if no type allowed for the suffix can represent val
+bool type_climb(EIntegerSuffix suffix, bool isDec,
                 unsigned long long val, EFundamentalType &type, size_t &width) {
-
-  fit_checker checker(val, type, width);
-
-  if (hasU && hasLL) {
-    if (checker.check<unsigned long long>()) {
-      return;
-    }
-  } else if (hasLL) {
-    if (checker.check<long long int>() ||
-        (!isDec && checker.check<unsigned long long int>())) {
-      return;
-    }
-  } else if (hasU && hasL) {
-    if (checker.check<unsigned long int>() ||
-        checker.check<unsigned long long int>()) {
-      return;
-    }
-  } else if (hasL) {
-    if (isDec) {
-      if (checker.check<long int>() ||
-          checker.check<long long int>()) {
-        return;
-      }
-    } else {
-      if (checker.check<long int>() ||
-          checker.check<unsigned long int>() ||
-          checker.check<long long int>() ||
-          checker.check<unsigned long long int>()) {
-        return;
-      }
-    }
-  } else if (hasU) {
-    if (checker.check<unsigned int>() ||
-        checker.check<unsigned long int>() ||
-        checker.check<unsigned long long int>()) {
-      return;
-    }
-  } else {
-    if (isDec) {
-      if (checker.check<int>() ||
-          checker.check<long int>() ||
-          checker.check<long long int>()) {
-        return;
-      }
-    } else {
-      if (checker.check<int>() ||
-          checker.check<unsigned int>() ||
-          checker.check<long int>() ||
-          checker.check<unsigned long int>() ||
-          checker.check<long long int>() ||
-          checker.check<unsigned long long int>()) {
-        return;
-      }
+  const IntegerPromotion &promotion = IntegerPromotionTable[suffix][isDec];
+  for (size_t i = 0; i < promotion.count; ++i) {
+    if (val <= promotion.candidates[i].max) {
+      type = promotion.candidates[i].type;
+      width = promotion.candidates[i].width;
+      return true;
     }
   }
-  throw PostException("integer constant is too large for its type");
+  return false;
 }
 
 
-struct PostTokenizer {
+struct PostTokenizer : PPTokenConsumer {
 
   PostTokenizer(DebugPostTokenOutputStream &out) : output(out) {}
 
-  void process(const PPToken &token) {
+  void process(PPToken &token) {
 
     if (!pending.empty()) {
       if (token.type == PPTokenType::Tk_StringLiteral ||
           token.type == PPTokenType::Tk_UdStringLiteral) {
-        pending.push_back(token);
+        pending.push_back(std::move(token));
         return;
       } else {
         process_PendingStringLiteral();
       }
     } else if (token.type == PPTokenType::Tk_StringLiteral
                || token.type == PPTokenType::Tk_UdStringLiteral) {
-      pending.push_back(token);
+      pending.push_back(std::move(token));
       return;
     }
 
@@ -1119,11 +1050,11 @@ private:
   void advance_EscapeSequence(const string &str, char delimiter,
                               string::size_type &index, int &val) {
     const auto sz = str.size();
-    auto it = SimpleEscapeSequenceMap.find(str[index]);
+    char simple = SimpleEscapeValue(str[index]);
 
-    if (it != SimpleEscapeSequenceMap.end()) {
+    if (simple != 0) {
       // simple-escape-sequence
-      val = it->second;
+      val = simple;
       ++index;
     } else if (str[index] == 'x') {
       // hexadecimal-escape-sequence
@@ -1354,11 +1285,9 @@ private:
         if (isUtf8) {
           data.append(content);
         } else if (isUtf16) {
-          data.append(utf8To16(content));
-        } else if (isUtf32) {
-          data.append(utf8To32(content));
+          utf8To16(content, data);
         } else {
-          data.append(utf8ToWchar(content));
+          utf8To32(content, data);
         }
       }
 
@@ -1402,69 +1331,38 @@ private:
     if (isInvalidOperator(token.data)) {
       output.emit_invalid(token.data);
     } else {
-      auto it = StringToTokenTypeMap.find(token.data);
-      if (it == StringToTokenTypeMap.end()) {
+      ETokenType type;
+      if (!findSimpleToken(token.data, type)) {
         output.emit_invalid(token.data);
       } else {
-        output.emit_simple(token.data, it->second);
+        output.emit_simple(token.data, type);
       }
     }
   }
 
   void process_Identifier(const PPToken &token) {
-    auto it = StringToTokenTypeMap.find(token.data);
-    if (it != StringToTokenTypeMap.end()) {
-      output.emit_simple(token.data, it->second);
+    ETokenType type;
+    if (findSimpleToken(token.data, type)) {
+      output.emit_simple(token.data, type);
     } else {
       output.emit_identifier(token.data);
     }
   }
 
-  EFundamentalType parseIntegerType(const string &suffix, unsigned long long val,
-                                    bool isHex, bool isOct, size_t &width) {
-    EFundamentalType type = FT_INT;
-    width = sizeof(int);
-
-    bool hasU, hasL, hasLL;
-    hasU = hasL = hasLL = false;
-
-    if (!suffix.empty()) {
-      switch (suffix.size()) {
-        case 1: {
-          if (std::tolower(suffix[0]) == 'u') {
-            hasU = true;
-          } else if (std::tolower(suffix[0]) == 'l') {
-            hasL = true;
-          } else {
-            ASSERT(false, "never reach here");
-          }
-        }
-          break;
-        case 2: {
-          string str(suffix);
-          for (auto &c : str) {
-            c = static_cast<char>((std::tolower(c)));
-          }
-
-          if (str == "ll") {
-            hasLL = true;
-          } else {
-            ASSERT(str == "lu" || str == "ul", "type must be unsigned long");
-            hasU = hasL = true;
-          }
-        }
-          break;
-        case 3: {
-          hasU = hasLL = true;
-        }
-          break;
-        default:
-          ASSERT(false, "never reach here");
+  bool parseIntegerType(const string &suffix, unsigned long long val,
+                        bool isHex, bool isOct, EFundamentalType &type, size_t &width) {
+    // checkIntegerSuffix has validated the suffix, only the letters matter
+    int hasU = 0, longs = 0;
+    for (char c : suffix) {
+      if (c == 'u' || c == 'U') {
+        hasU = 1;
+      } else {
+        ++longs;
       }
     }
 
-    type_climb(hasU, hasL, hasLL, !(isHex || isOct), val, type, width);
-    return type;
+    auto integerSuffix = static_cast<EIntegerSuffix>(3 * hasU + longs);
+    return type_climb(integerSuffix, !(isHex || isOct), val, type, width);
   }
 
   EFundamentalType parseFloatType(const string &suffix, size_t &width) {
@@ -1509,9 +1407,8 @@ private:
     EFundamentalType type;
     size_t width;
 
-    string sub = token.data.substr(0, index);
-
     if (isUser) {
+      string sub = token.data.substr(0, index);
       if (isFloat) {
         output.emit_user_defined_literal_floating(token.data, ud_suffix, sub);
       } else {
@@ -1521,6 +1418,7 @@ private:
     }
 
     if (isFloat) {
+      string sub = token.data.substr(0, index);
       type = parseFloatType(suffix, width);
       switch (type) {
         case FT_FLOAT: {
@@ -1534,7 +1432,10 @@ private:
         }
           break;
         case FT_LONG_DOUBLE: {
-          long double val = PA2Decode_long_double(sub);
+          // the padding after the 80-bit value is part of the dump
+          long double val;
+          memset(&val, 0, sizeof val);
+          val = PA2Decode_long_double(sub);
           output.emit_literal(token.data, type, &val, width);
         }
           break;
@@ -1542,26 +1443,24 @@ private:
           ASSERT(false, "never reach here");
       }
     } else {
-      int base = 10;
+      unsigned base = 10;
+      string::size_type begin = 0;
       if (isHex) {
         base = 16;
+        begin = 2;
       }
       if (isOct) {
         base = 8;
       }
 
       unsigned long long val;
-      if (!toUnsignedLongLong(sub, base, val)) {
+      if (!scanIntegerDigits(token.data, begin, index, base, val)) {
+        output.emit_invalid(token.data);
+      } else if (!parseIntegerType(suffix, val, isHex, isOct, type, width)) {
         output.emit_invalid(token.data);
+        cerr << "ERROR: integer constant is too large for its type" << endl;
       } else {
-
-        try {
-          type = parseIntegerType(suffix, val, isHex, isOct, width);
-          output.emit_literal(token.data, type, (const void *) &val, width);
-        } catch (const PostException &e) {
-          output.emit_invalid(token.data);
-          cerr << "ERROR: " << e.what() << endl;
-        }
+        output.emit_literal(token.data, type, (const void *) &val, width);
       }
     }
   }
@@ -1882,16 +1781,16 @@ private:
 
     if (str[index + 1] == '\\') {
       ASSERT(sz > 3, "string size must greater than 3");
-      auto it = SimpleEscapeSequenceMap.find(str[index + 2]);
+      char simple = SimpleEscapeValue(str[index + 2]);
 
-      if (it != SimpleEscapeSequenceMap.end()) {
+      if (simple != 0) {
 
         if (type == FT_INT) {
           type = FT_CHAR;
           width = sizeof(char);
         }
 
-        cp = (char32_t) it->second;
+        cp = (char32_t) simple;
         if (str[index + 3] != '\'') {
           throw PostException("multi code point character literals not supported: " + str);
         }
@@ -1980,34 +1879,124 @@ private:
   std::vector<PPToken> pending;
 };
 
-int main() {
+// MappedFile: read-only memory mapping of a source file
+struct MappedFile {
+  explicit MappedFile(const char *path) : data_(nullptr), size_(0) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      throw runtime_error(string("cannot open ") + path + ": " + strerror(errno));
+    }
 
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+      close(fd);
+      throw runtime_error(string("not a regular file: ") + path);
+    }
 
-  try {
-    ostringstream oss;
-    oss << cin.rdbuf();
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        close(fd);
+        throw runtime_error(string("cannot map ") + path + ": " + strerror(errno));
+      }
+      madvise(p, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char *>(p);
+    }
+    close(fd);
+  }
 
-    string input = oss.str();
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
 
-    DebugPostTokenOutputStream output;
-    DebugPPTokenStream ppTokenStream;
-    PPTokenizer tokenizer(ppTokenStream);
-    PostTokenizer postTokenizer(output);
+  MappedFile(const MappedFile &) = delete;
 
-    for (char c : input) {
-      auto code_unit = static_cast<unsigned char>(c);
-      tokenizer.process(code_unit);
+  MappedFile &operator=(const MappedFile &) = delete;
 
-      while (!ppTokenStream.empty()) {
-        postTokenizer.process(ppTokenStream.next());
-      }
+  const char *begin() const {
+    return data_;
+  }
+
+  const char *end() const {
+    return data_ + size_;
+  }
+
+private:
+  const char *data_;
+  size_t size_;
+};
+
+// size of the blocks read from a non-mappable input
+constexpr size_t ReadBlockSize = 64 * 1024;
+
+// StreamReader: reads a file descriptor in fixed-size blocks
+struct StreamReader {
+  explicit StreamReader(int fd) : fd_(fd), buffer_(ReadBlockSize) {}
+
+  // read the next block into [begin, end), return false at end of input
+  bool next(const char *&begin, const char *&end) {
+    ssize_t n;
+    do {
+      n = read(fd_, buffer_.data(), buffer_.size());
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+      throw runtime_error(string("read error: ") + strerror(errno));
     }
 
+    begin = buffer_.data();
+    end = begin + n;
+    return n > 0;
+  }
+
+private:
+  int fd_;
+  vector<char> buffer_;
+};
+
+// Translation: phases 1-7 over one translation unit, fed piece by piece
+struct Translation {
+  // the pp-token stream hands each token to phase 7 as soon as it is emitted
+  Translation() : postTokenizer(output), ppTokenStream(postTokenizer), tokenizer(ppTokenStream) {}
+
+  void process(const char *begin, const char *end) {
+    tokenizer.process(begin, end);
+  }
+
+  void finish() {
     tokenizer.process(EndOfFile);
-    while (!ppTokenStream.empty()) {
-      postTokenizer.process(ppTokenStream.next());
-    }
+  }
+
+private:
+  DebugPostTokenOutputStream output;
+  PostTokenizer postTokenizer;
+  DebugPPTokenStream ppTokenStream;
+  PPTokenizer tokenizer;
+};
 
+int main(int argc, char **argv) {
+
+  try {
+    if (argc > 1) {
+      // each argument names a translation unit, tokenized in place
+      for (int i = 1; i < argc; i++) {
+        MappedFile file(argv[i]);
+        Translation translation;
+        translation.process(file.begin(), file.end());
+        translation.finish();
+      }
+    } else {
+      Translation translation;
+      StreamReader reader(STDIN_FILENO);
+      const char *begin, *end;
+      while (reader.next(begin, end)) {
+        translation.process(begin, end);
+      }
+      translation.finish();
+    }
   } catch (exception &e) {
     cerr << "ERROR: " << e.what() << endl;
     return EXIT_FAILURE;
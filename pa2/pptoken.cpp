@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -6,18 +7,26 @@
 #include <fstream>
 #include <stdexcept>
 #include <algorithm>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
 #include <vector>
 #include <deque>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "DebugPPTokenStream.h"
 
 using namespace std;
 
 #include "IPPTokenStream.h"
 #include "DebugPPTokenStream.h"
+#include "Utf8Decoder.h"
+#include "AnnexE.h"
+#include "OpOrPunc.h"
 
 
 // Translation features you need to implement:
@@ -33,65 +42,90 @@ using namespace std;
 
 constexpr int LF = 0x0A;
 
+// True for code units that phases 1-2 or the string modes must look at:
+// the starts of trigraphs, splices, UCNs and comments, quotes, newlines and
+// anything that is not plain ASCII.
+inline bool isSpecialCodeUnit(unsigned char c) {
+  return c >= 0x7f || c == '/' || c == '\\' || c == '?' || c == '"' ||
+         c == '\'' || c == LF;
+}
 
-// See C++ standard 2.11 Identifiers and Appendix/Annex E.1
-const vector<pair<int, int>> AnnexE1_Allowed_RangesSorted =
-  {
-    {0xA8,    0xA8},
-    {0xAA,    0xAA},
-    {0xAD,    0xAD},
-    {0xAF,    0xAF},
-    {0xB2,    0xB5},
-    {0xB7,    0xBA},
-    {0xBC,    0xBE},
-    {0xC0,    0xD6},
-    {0xD8,    0xF6},
-    {0xF8,    0xFF},
-    {0x100,   0x167F},
-    {0x1681,  0x180D},
-    {0x180F,  0x1FFF},
-    {0x200B,  0x200D},
-    {0x202A,  0x202E},
-    {0x203F,  0x2040},
-    {0x2054,  0x2054},
-    {0x2060,  0x206F},
-    {0x2070,  0x218F},
-    {0x2460,  0x24FF},
-    {0x2776,  0x2793},
-    {0x2C00,  0x2DFF},
-    {0x2E80,  0x2FFF},
-    {0x3004,  0x3007},
-    {0x3021,  0x302F},
-    {0x3031,  0x303F},
-    {0x3040,  0xD7FF},
-    {0xF900,  0xFD3D},
-    {0xFD40,  0xFDCF},
-    {0xFDF0,  0xFE44},
-    {0xFE47,  0xFFFD},
-    {0x10000, 0x1FFFD},
-    {0x20000, 0x2FFFD},
-    {0x30000, 0x3FFFD},
-    {0x40000, 0x4FFFD},
-    {0x50000, 0x5FFFD},
-    {0x60000, 0x6FFFD},
-    {0x70000, 0x7FFFD},
-    {0x80000, 0x8FFFD},
-    {0x90000, 0x9FFFD},
-    {0xA0000, 0xAFFFD},
-    {0xB0000, 0xBFFFD},
-    {0xC0000, 0xCFFFD},
-    {0xD0000, 0xDFFFD},
-    {0xE0000, 0xEFFFD}
-  };
+// Returns the first special code unit in [p, end), or end.
+const char *findSpecialCodeUnit(const char *p, const char *end) {
+#if defined(__SSE2__)
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i back_slash = _mm_set1_epi8('\\');
+  const __m128i question = _mm_set1_epi8('?');
+  const __m128i double_quote = _mm_set1_epi8('"');
+  const __m128i single_quote = _mm_set1_epi8('\'');
+  const __m128i line_feed = _mm_set1_epi8(LF);
+  const __m128i del = _mm_set1_epi8(0x7f);
+
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // bytes >= 0x80 already carry the sign bit
+    __m128i hit = _mm_or_si128(v, _mm_cmpeq_epi8(v, del));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, slash));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, back_slash));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, question));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, double_quote));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, single_quote));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, line_feed));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  while (p != end && !isSpecialCodeUnit(static_cast<unsigned char>(*p))) {
+    ++p;
+  }
+  return p;
+}
 
-// See C++ standard 2.11 Identifiers and Appendix/Annex E.2
-const vector<pair<int, int>> AnnexE2_DisallowedInitially_RangesSorted =
-  {
-    {0x300,  0x36F},
-    {0x1DC0, 0x1DFF},
-    {0x20D0, 0x20FF},
-    {0xFE20, 0xFE2F}
-  };
+// Returns the first ')' or non-ASCII code unit in [p, end), or end: the
+// only code units a raw string body cannot take verbatim.
+const char *findRawStringCodeUnit(const char *p, const char *end) {
+#if defined(__SSE2__)
+  const __m128i right_paren = _mm_set1_epi8(')');
+  const __m128i del = _mm_set1_epi8(0x7f);
+
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i hit = _mm_or_si128(v, _mm_cmpeq_epi8(v, del));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, right_paren));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  while (p != end && *p != ')' && static_cast<unsigned char>(*p) < 0x7f) {
+    ++p;
+  }
+  return p;
+}
+
+
+// CodePointSet: O(1) membership test for code points up to 0x10FFFF, as a
+// two-level bitmap generated into AnnexE.h; pages of 256 code points with
+// equal bits share a block
+struct CodePointSet {
+  const uint8_t *pages;
+  const uint64_t (*blocks)[4];
+
+  bool contains(int c) const {
+    if (static_cast<unsigned>(c) > 0x10FFFF) {
+      return false;
+    }
+    const uint64_t *block = blocks[pages[c >> 8]];
+    return (block[(c >> 6) & 3] >> (c & 63)) & 1;
+  }
+};
+
+// See C++ standard 2.11 Identifiers and Appendix/Annex E.1 and E.2
+const CodePointSet AnnexE1_Allowed = {AnnexE1_AllowedPages, AnnexE1_AllowedBlocks};
+const CodePointSet AnnexE2_DisallowedInitially = {AnnexE2_DisallowedInitiallyPages, AnnexE2_DisallowedInitiallyBlocks};
 
 // See C++ standard 2.13 Operators and punctuators
 const unordered_set<string> Digraph_IdentifierLike_Operators =
@@ -101,49 +135,77 @@ const unordered_set<string> Digraph_IdentifierLike_Operators =
     "or_eq", "xor", "xor_eq"
   };
 
-// See `simple-escape-sequence` grammar
-const unordered_set<int> SimpleEscapeSequence_CodePoints =
-  {
-    '\'', '"', '?', '\\', 'a', 'b', 'f', 'n', 'r', 't', 'v'
-  };
-
+// See `simple-escape-sequence` grammar and C++ standard 2.13
+enum CharClass {
+  CC_Digit = 0x01,        // [0-9]
+  CC_NonDigit = 0x02,     // [_a-zA-Z]
+  CC_Hex = 0x04,          // [0-9a-fA-F]
+  CC_Space = 0x08,        // std::isspace in the "C" locale
+  CC_OpOrPunc = 0x10,     // single character preprocessing-op-or-punc
+  CC_SimpleEscape = 0x20, // character following '\\' in a simple-escape-sequence
+  CC_Dot = 0x40,          // .
+};
+
+static constexpr bool isOneOf(const char *s, int c) {
+  return *s != '\0' && (*s == c || isOneOf(s + 1, c));
+}
 
-const unordered_set<int> SingleCharacter_Op_or_Punc =
-  {
-    '{', '}', '[', ']', '#', '(', ')', ';', ':', '?', '.',
-    '+', '-', '*', '/', '%', '^', '&', '|', '~', '!', '=', '<', '>', ',',
-  };
+static constexpr unsigned char charClassOf(int c) {
+  return static_cast<unsigned char>(
+    ((c >= '0' && c <= '9') ? CC_Digit : 0) |
+    ((c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) ? CC_NonDigit : 0) |
+    (((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')) ? CC_Hex : 0) |
+    (isOneOf(" \t\n\v\f\r", c) ? CC_Space : 0) |
+    (isOneOf("{}[]#();:?.+-*/%^&|~!=<>,", c) ? CC_OpOrPunc : 0) |
+    (isOneOf("'\"?\\abfnrtv", c) ? CC_SimpleEscape : 0) |
+    (c == '.' ? CC_Dot : 0));
+}
 
-const unordered_set<string> TwoCharacter_Op_or_Punc =
-  {
-    "##", "<:", ":>", "<%", "%>", "%:", "::", ".*", "->",
-    "+=", "-=", "*=", "/=", "%=", "^=", "&=", "|=", "==",
-    "!=", "<=", ">=", "&&", "||", "<<", ">>", "++", "--",
-  };
+// f of the 16 code points starting at i
+#define CODE_POINT_ROW(f, i) \
+  f(i + 0x0), f(i + 0x1), f(i + 0x2), f(i + 0x3), f(i + 0x4), f(i + 0x5), f(i + 0x6), f(i + 0x7), \
+  f(i + 0x8), f(i + 0x9), f(i + 0xA), f(i + 0xB), f(i + 0xC), f(i + 0xD), f(i + 0xE), f(i + 0xF)
 
-const unordered_set<string> ThreeCharacter_Op_or_Punc =
+// classes of the ASCII code points; the upper half stays empty so that any
+// code point below 0x100 can index the table, the rest take the Unicode path
+static constexpr unsigned char CharClassTable[256] =
   {
-    "...", "->*", "<=>", "<<=", ">>=", "<::",
+    CODE_POINT_ROW(charClassOf, 0x00),
+    CODE_POINT_ROW(charClassOf, 0x10),
+    CODE_POINT_ROW(charClassOf, 0x20),
+    CODE_POINT_ROW(charClassOf, 0x30),
+    CODE_POINT_ROW(charClassOf, 0x40),
+    CODE_POINT_ROW(charClassOf, 0x50),
+    CODE_POINT_ROW(charClassOf, 0x60),
+    CODE_POINT_ROW(charClassOf, 0x70)
   };
 
-const unordered_set<string> FourCharacter_Op_or_Punc =
-  {
-    "%:%:", "<::>", "<:::",
-  };
+static inline bool hasCharClass(int c, int cls) {
+  return static_cast<unsigned>(c) < 0x100 && (CharClassTable[c] & cls) != 0;
+}
 
+// Returns the end of the run of [_a-zA-Z0-9] code units at p, with '.' too
+// for pp-numbers.
+static const char *findWordEnd(const char *p, const char *end, bool with_dot) {
+  int cls = with_dot ? CC_Digit | CC_NonDigit | CC_Dot : CC_Digit | CC_NonDigit;
+  while (p != end && (CharClassTable[static_cast<unsigned char>(*p)] & cls) != 0) {
+    ++p;
+  }
+  return p;
+}
 
-static bool isCharacterLiteralPrefix(const vector<int> &data) {
+static bool isCharacterLiteralPrefix(const string &data) {
   return data.size() == 1 && (
     data.back() == 'u' || data.back() == 'U' || data.back() == 'L');
 }
 
-static bool isNormalStringLiteralPrefix(const vector<int> &data) {
+static bool isNormalStringLiteralPrefix(const string &data) {
   auto sz = data.size();
   return (sz == 1 && (data.front() == 'u' || data.front() == 'U' || data.front() == 'L')) ||
          (sz == 2 && data.front() == 'u' && data.back() == '8');
 }
 
-static bool isRawStringLiteralPrefix(const vector<int> &data) {
+static bool isRawStringLiteralPrefix(const string &data) {
   auto sz = data.size();
   return (sz == 1 && data.front() == 'R') ||
          (sz == 2 && (data.front() == 'u' || data.front() == 'U' || data.front() == 'L') && data.back() == 'R') ||
@@ -161,7 +223,48 @@ static int str2int(const string &str, int base) {
 }
 
 static inline bool isHex(int c) {
-  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+  return hasCharClass(c, CC_Hex);
+}
+
+static inline bool isDigit(int c) {
+  return hasCharClass(c, CC_Digit);
+}
+
+// Returns the end of the escape sequence starting at the backslash p when
+// it is complete in [p, end) and phases 1-2 pass it through unchanged, p
+// otherwise.
+static const char *skipEscapeSequence(const char *p, const char *end) {
+  if (end - p < 3) {
+    return p;
+  }
+
+  int c = static_cast<unsigned char>(p[1]);
+  const char *q = p + 2;
+
+  if (c == 'x') {
+    while (q != end && isHex(static_cast<unsigned char>(*q))) {
+      ++q;
+    }
+    if (q == p + 2 || q == end) {
+      return p;
+    }
+  } else if (c >= '0' && c <= '7') {
+    while (q != end && q != p + 4 && *q >= '0' && *q <= '7') {
+      ++q;
+    }
+    if (q == end) {
+      return p;
+    }
+  } else if (c == '\\') {
+    // the second backslash may still start a splice or a UCN
+    if (*q == LF || *q == 'u' || *q == 'U') {
+      return p;
+    }
+  } else if (c == '?' || !hasCharClass(c, CC_SimpleEscape)) {
+    // \? may be followed by a trigraph, other escapes are errors
+    return p;
+  }
+  return q;
 }
 
 
@@ -169,36 +272,31 @@ static int toCodePoint(const string &text) {
   return str2int(text, 16);
 }
 
-static inline bool isUtf8Trailing(int c) {
-  return ((c >> 6) & 0x03) == 0x02;
+bool isNonDigit(int c) {
+  return hasCharClass(c, CC_NonDigit);
 }
 
-inline bool isNonDigit(int c) {
-  return (c == '_') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+bool isInAnnexE1(int c) {
+  return AnnexE1_Allowed.contains(c);
 }
 
-inline bool isInAnnexE1(int c) {
-  // TODO: Optimize Query Speed
-  for (const auto &p : AnnexE1_Allowed_RangesSorted) {
-    if (c >= p.first && c <= p.second) {
-      return true;
-    }
-  }
-  return false;
+static inline bool isInAnnexE2(int c) {
+  return AnnexE2_DisallowedInitially.contains(c);
 }
 
-static inline bool isInAnnexE2(int c) {
-  // TODO: Optimize Query Speed
-  for (const auto &p : AnnexE2_DisallowedInitially_RangesSorted) {
-    if (c >= p.first && c <= p.second) {
-      return true;
-    }
+static inline bool isIdentifierNonDigit(int c) {
+  if (c < 0x80) {
+    return hasCharClass(c, CC_NonDigit);
   }
-  return false;
+  return isInAnnexE1(c) && !isInAnnexE2(c);
 }
 
-static inline bool isIdentifierNonDigit(int c) {
-  return (isNonDigit(c) || isInAnnexE1(c)) && !isInAnnexE2(c);
+// digit or identifier-nondigit after the first character of an identifier
+static inline bool isIdentifierChar(int c) {
+  if (c < 0x80) {
+    return hasCharClass(c, CC_Digit | CC_NonDigit);
+  }
+  return isInAnnexE1(c);
 }
 
 static inline string codePoint2String(int c) {
@@ -235,30 +333,39 @@ static inline string codePoint2String(int c) {
   return data;
 }
 
-static string codePoints2String(const vector<int> &cps) {
-  string data;
-  for (const int c : cps) {
-    data.append(codePoint2String(c));
-  }
-  return data;
-}
+// longest of Digraph_IdentifierLike_Operators
+constexpr size_t MaxIdentifierLikeOperatorSize = 6;
 
 
 PPTokenizer::PPTokenizer(IPPTokenStream &output)
+  : adapter_(new PPTokenViewStreamAdapter(output)), output(*adapter_) {
+  init();
+}
+
+PPTokenizer::PPTokenizer(IPPTokenViewStream &output)
   : output(output) {
+  init();
+}
+
+void PPTokenizer::init() {
   state_ = S_None;
   inner_state_ = Inner_None;
   decode_state_ = D_None;
   last_code_point_ = -1;
   last_but_one_code_point_ = -1;
+  is_prev_back_slash_ = false;
+  comment_question_marks_ = 0;
   is_normal_string_mode_ = false;
   is_raw_string_mode_ = false;
   is_prev_whitespace_ = false;
   is_prev_new_line_ = true;
   is_prev_pound_key_ = false;
   is_prev_include_ = false;
-  is_prev_right_paren_ = false;
-  compare_index_ = 0;
+  op_node_ = OpOrPuncRoot;
+  cursor_ = nullptr;
+  source_ = nullptr;
+  token_begin_ = nullptr;
+  token_end_ = nullptr;
 }
 
 void PPTokenizer::process(int c) {
@@ -269,45 +376,134 @@ void PPTokenizer::process(int c) {
 
   int cp;
 
-  if (decode(c)) {
+  decode(c);
+
+  // tokenize every code point decoded so far, so that the decoder never
+  // runs ahead of the string/raw-string modes set by the tokenizer
+  while (!code_points_.empty()) {
     cp = code_points_.front();
     code_points_.pop_front();
+
+    // code points matching the input byte for byte keep their position
+    if (source_ != nullptr && cp < 0x80 && cp == static_cast<unsigned char>(*source_)) {
+      cursor_ = source_++;
+    } else {
+      cursor_ = source_ = nullptr;
+    }
+
     step(cp);
     last_but_one_code_point_ = last_code_point_;
     last_code_point_ = cp;
   }
+}
 
-  if (c == EndOfFile) {
-    while (!code_points_.empty()) {
-      cp = code_points_.front();
-      code_points_.pop_front();
+void PPTokenizer::process(const char *begin, const char *end) {
+
+  // code units that phases 1-2 pass through unchanged go straight to the
+  // tokenizer; everything else takes the per-code-unit path above
+
+  // validate the block up front: multi-byte sequences inside
+  // [valid_begin, valid_end) skip the checks of the UTF-8 state, while the
+  // trailing code units of a sequence carried over from the previous block,
+  // and anything from the first invalid or incomplete sequence on, still go
+  // through it
+  const char *valid_begin = begin;
+  while (valid_begin != end && valid_begin - begin < 3 && isUtf8Trailing(static_cast<uint8_t>(*valid_begin))) {
+    ++valid_begin;
+  }
+  const char *valid_end = findUtf8ValidEnd(valid_begin, end);
+
+  for (const char *p = begin; p != end; ++p) {
+    if (state_ == S_StartRawStringLiteralRChar && decode_state_ == D_None) {
+      p = scanRawStringBody(p, end);
+    } else if ((state_ == S_StartNormalStringLiteral || state_ == S_StartCharacterLiteral) &&
+               inner_state_ == Inner_None && decode_state_ == D_None) {
+      p = scanQuotedLiteralBody(p, end);
+    } else if (decode_state_ == D_None) {
+      // between phase 1-2 sequences, whole runs of plain code units are
+      // transparent in every mode: they cannot start a sequence and cannot
+      // switch the string modes
+      const char *run_end = findSpecialCodeUnit(p, end);
+      while (p != run_end) {
+        // identifiers and pp-numbers take the rest of their run at once
+        if (state_ == S_Identifier || state_ == S_PPNumber) {
+          const char *word_end = findWordEnd(p, run_end, state_ == S_PPNumber);
+          if (word_end != p) {
+            appendRun(p, word_end);
+            if (state_ == S_PPNumber && (word_end[-1] == 'e' || word_end[-1] == 'E')) {
+              state_ = S_PPNumberExpectSign;
+            }
+            p = word_end;
+            continue;
+          }
+        }
+
+        int c = static_cast<unsigned char>(*p);
+        cursor_ = p;
+        step(c);
+        last_but_one_code_point_ = last_code_point_;
+        last_code_point_ = c;
+        ++p;
+      }
+    } else if (decode_state_ == D_SingleLineComment) {
+      // comment bodies are skipped up to the code unit that ends them
+      p = skipLineComment(p, end);
+    } else if (decode_state_ == D_InlineComment ||
+               decode_state_ == D_MayEndInlineComment) {
+      p = skipInlineComment(p, end);
+    }
+    if (p == end) {
+      break;
+    }
+
+    int c = static_cast<unsigned char>(*p);
+
+    // a lead code unit in the validated range decodes its whole sequence
+    if (c >= 0xc0 && decode_state_ == D_None && p >= valid_begin && p < valid_end) {
+      const char *next = p;
+      int cp = static_cast<int>(decodeUtf8Unchecked(next));
+      cursor_ = source_ = nullptr;
       step(cp);
       last_but_one_code_point_ = last_code_point_;
       last_code_point_ = cp;
+      p = next - 1;
+      continue;
+    }
+
+    if (isTransparentCodeUnit(c)) {
+      cursor_ = p;
+      step(c);
+      last_but_one_code_point_ = last_code_point_;
+      last_code_point_ = c;
+    } else {
+      // a new phase 1-2 sequence starts here
+      if (decode_state_ == D_None) {
+        source_ = p;
+      }
+      process(c);
     }
   }
+
+  // the caller may reuse the buffer, so a token still in progress can no
+  // longer be viewed in place
+  cursor_ = source_ = nullptr;
+  token_begin_ = nullptr;
 }
 
 
+// a sequence runs for as many trailing code units as its lead asks for, and
+// one the automaton rejects is only reported once it is complete, so that a
+// missing trailing code unit is reported first
 void PPTokenizer::beginUTF8State(int c) {
-  decode_state_ = D_UTF8;
-  counts_ = 0;
-
-  int shift = 7;
-  while ((shift >= 4) && ((c >> shift) & 0x01)) {
-    shift--;
-    counts_++;
+  uint8_t lead = static_cast<uint8_t>(c);
+  if (isUtf8Trailing(lead)) {
+    throw utf8RejectReason(Utf8Accept, lead);
   }
 
-  if (shift < 3) {
-    throw "utf8 invalid unit (11111xx)";
-  } else if (shift > 5) {
-    throw "utf8 trailing code unit (10xxxxxx) at start";
-  } else {
-    --counts_;
-    ASSERT(buffer_.empty(), "buffer must be empty");
-    buffer_.push_back((char) (c & (~(0xff << shift))));
-  }
+  decode_state_ = D_UTF8;
+  utf8_trailing_ = lead < 0xe0 ? 1 : lead < 0xf0 ? 2 : 3;
+  utf8_state_ = decodeUtf8(Utf8Accept, utf8_code_point_, lead);
+  utf8_reject_reason_ = utf8_state_ == Utf8Reject ? utf8RejectReason(Utf8Accept, lead) : nullptr;
 }
 
 bool PPTokenizer::decode_None(int c) {
@@ -315,7 +511,7 @@ bool PPTokenizer::decode_None(int c) {
 
   bool ret = false;
 
-  if (c < 0x7f) {
+  if (c < 0x80) {
     if (c == '/') {
       decode_state_ = D_ForwardSlash;
     } else if (c == '\\') {
@@ -334,32 +530,25 @@ bool PPTokenizer::decode_None(int c) {
 }
 
 bool PPTokenizer::decode_UTF8(int c) {
-
-  bool ret = false;
-
-  if (isUtf8Trailing(c)) {
-    ASSERT(counts_ > 0, "the count of remaining trailing bytes must be greater than 0");
-    buffer_.push_back((char) (c & 0x3f));
-    --counts_;
-    if (counts_ == 0) {
-
-      auto sz = buffer_.size(), shift = 6 * (sz - 1);
-      int code = (int) (buffer_.front()) << shift;
-
-      for (auto i = 1u; i < sz; i++) {
-        shift -= 6;
-        code |= ((int) (buffer_[i]) << shift);
-      }
-      code_points_.push_back(code);
-      decode_state_ = D_None;
-      buffer_.clear();
-      ret = true;
-    }
-  } else {
+  if (c == EndOfFile || !isUtf8Trailing(static_cast<uint8_t>(c))) {
     throw "utf8 expected trailing byte (10xxxxxx)";
   }
 
-  return ret;
+  uint32_t state = decodeUtf8(utf8_state_, utf8_code_point_, static_cast<uint8_t>(c));
+  if (state == Utf8Reject && utf8_reject_reason_ == nullptr) {
+    utf8_reject_reason_ = utf8RejectReason(utf8_state_, static_cast<uint8_t>(c));
+  }
+
+  utf8_state_ = state;
+  if (--utf8_trailing_ > 0) {
+    return false;
+  }
+  if (utf8_reject_reason_ != nullptr) {
+    throw utf8_reject_reason_;
+  }
+  code_points_.push_back(static_cast<int>(utf8_code_point_));
+  decode_state_ = D_None;
+  return true;
 }
 
 bool PPTokenizer::decode_ForwardSlash(int c) {
@@ -375,12 +564,23 @@ bool PPTokenizer::decode_ForwardSlash(int c) {
     // line comment
     decode_state_ = D_SingleLineComment;
     is_prev_back_slash_ = false;
+    comment_question_marks_ = 0;
 
-    if (state_ != S_None) {
+    if (state_ == S_StartOpOrPunc) {
+      // the comment ends the candidate like any non-operator character
+      while (state_ == S_StartOpOrPunc) {
+        splitOpOrPunc(c);
+      }
+    } else if (state_ != S_None) {
       emit(c, false);
     }
   } else if (c == '*') {
     decode_state_ = D_InlineComment;
+
+    // and so does a block comment, which may turn out to be unterminated
+    while (state_ == S_StartOpOrPunc) {
+      splitOpOrPunc(c);
+    }
   } else {
     code_points_.push_back('/');
     decode_state_ = D_None;
@@ -537,6 +737,12 @@ bool PPTokenizer::decode_MayBeTriGraph2(int c) {
   return ret;
 }
 
+void PPTokenizer::trackCommentBackSlash(int c) {
+  // a backslash is spelled either directly or as the ??/ trigraph
+  is_prev_back_slash_ = c == '\\' || (c == '/' && comment_question_marks_ == 2);
+  comment_question_marks_ = c == '?' ? min(comment_question_marks_ + 1, 2) : 0;
+}
+
 void PPTokenizer::decode_SingleLineComment(int c) {
   if (c == EndOfFile) {
     code_points_.push_back(' ');
@@ -550,10 +756,9 @@ void PPTokenizer::decode_SingleLineComment(int c) {
       code_points_.push_back(LF);
       is_prev_new_line_ = true;
     }
-  } else if (c == '\\') {
-    is_prev_back_slash_ = true;
+    comment_question_marks_ = 0;
   } else {
-    is_prev_back_slash_ = false;
+    trackCommentBackSlash(c);
   }
 }
 
@@ -563,28 +768,98 @@ void PPTokenizer::decode_InlineComment(int c) {
   }
   if (c == '*') {
     decode_state_ = D_MayEndInlineComment;
+    is_prev_back_slash_ = false;
+    comment_question_marks_ = 0;
   }
 }
 
+bool PPTokenizer::isInlineCommentEnd(int c) const {
+  return c == '/' && !is_prev_back_slash_ && comment_question_marks_ == 0;
+}
+
 void PPTokenizer::decode_MayEndInlineComment(int c) {
   if (c == EndOfFile) {
     throw "partial comment";
   }
-  if (c == '/') {
+
+  // only splices may come between the '*' and the '/', so keep a pending
+  // backslash or up to two '?' that may still spell one
+  bool is_pending = is_prev_back_slash_ || comment_question_marks_ != 0;
+
+  if (isInlineCommentEnd(c)) {
     decode_state_ = D_None;
     code_points_.push_back(' ');
+  } else if (c == '*') {
+    is_prev_back_slash_ = false;
+    comment_question_marks_ = 0;
+  } else if (c == LF && is_prev_back_slash_) {
+    is_prev_back_slash_ = false;
+  } else if ((c == '\\' && !is_pending) ||
+             (c == '?' && !is_prev_back_slash_ && comment_question_marks_ < 2) ||
+             (c == '/' && comment_question_marks_ == 2)) {
+    trackCommentBackSlash(c);
   } else {
     decode_state_ = D_InlineComment;
   }
 }
 
+const char *PPTokenizer::skipLineComment(const char *p, const char *end) {
+  while (p != end) {
+    const char *lf = static_cast<const char *>(memchr(p, LF, end - p));
+    if (lf == nullptr) {
+      lf = end;
+    }
+
+    // only the last three code units before a new-line can splice it
+    for (const char *q = lf - p > 3 ? lf - 3 : p; q != lf; ++q) {
+      trackCommentBackSlash(static_cast<unsigned char>(*q));
+    }
+    if (lf == end || !is_prev_back_slash_) {
+      return lf;
+    }
+    is_prev_back_slash_ = false;
+    p = lf + 1;
+  }
+  return p;
+}
+
+const char *PPTokenizer::skipInlineComment(const char *p, const char *end) {
+  while (p != end) {
+    if (decode_state_ == D_InlineComment) {
+      p = static_cast<const char *>(memchr(p, '*', end - p));
+      if (p == nullptr) {
+        return end;
+      }
+      decode_InlineComment('*');
+    } else {
+      int c = static_cast<unsigned char>(*p);
+      if (isInlineCommentEnd(c)) {
+        break;
+      }
+      decode_MayEndInlineComment(c);
+    }
+    ++p;
+  }
+  return p;
+}
+
+bool PPTokenizer::isTransparentCodeUnit(int c) const {
+  if (c >= 0x80) {
+    return false;
+  }
+  if (is_raw_string_mode_) {
+    return decode_state_ != D_UTF8;
+  }
+  return decode_state_ == D_None && c != '/' && c != '\\' && c != '?';
+}
+
 bool PPTokenizer::decode(int c) {
 
   DecodeState s = decode_state_;
   bool ret = false;
 
   if (is_raw_string_mode_ && s != D_UTF8) {
-    if (c < 0x7f) {
+    if (c < 0x80) {
       code_points_.push_back(c);
       ret = true;
     } else {
@@ -636,8 +911,136 @@ bool PPTokenizer::decode(int c) {
   return ret;
 }
 
+constexpr unsigned char PPTokenizer::stepClassOf(int c) {
+  return static_cast<unsigned char>(
+    (c == 'e' || c == 'E') ? SC_E :
+    (c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) ? SC_Letter :
+    (c >= '0' && c <= '9') ? SC_Digit :
+    c == '.' ? SC_Dot :
+    (c == '+' || c == '-') ? SC_Sign :
+    (c == '\'' || c == '"') ? SC_Quote :
+    (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r') ? SC_Space :
+    (c >= 0 && c < 0x80) ? SC_Break : SC_Other);
+}
+
+// the upper half stays SC_Other
+const unsigned char PPTokenizer::StepClassTable[256] =
+  {
+    CODE_POINT_ROW(stepClassOf, 0x00),
+    CODE_POINT_ROW(stepClassOf, 0x10),
+    CODE_POINT_ROW(stepClassOf, 0x20),
+    CODE_POINT_ROW(stepClassOf, 0x30),
+    CODE_POINT_ROW(stepClassOf, 0x40),
+    CODE_POINT_ROW(stepClassOf, 0x50),
+    CODE_POINT_ROW(stepClassOf, 0x60),
+    CODE_POINT_ROW(stepClassOf, 0x70)
+  };
+
+#undef CODE_POINT_ROW
+
+// white space and the transitions of identifiers, pp-numbers and ud-suffixes,
+// which make up most of the input; see the matching step_* functions
+constexpr PPTokenizer::StepEntry PPTokenizer::stepEntry(int state, int cls) {
+  return
+    cls == SC_Other ? StepEntry{A_Step, 0} :
+
+    // new-lines, literals and preprocessing-op-or-punc start in step_None
+    state == S_None ?
+      (cls == SC_Space ? StepEntry{A_Space, 0} :
+       (cls == SC_Letter || cls == SC_E) ? StepEntry{A_Begin, S_Identifier} :
+       cls == SC_Digit ? StepEntry{A_Begin, S_PPNumber} :
+       StepEntry{A_Step, 0}) :
+
+    // a quote may turn the identifier into an encoding-prefix
+    state == S_Identifier ?
+      ((cls == SC_Letter || cls == SC_E || cls == SC_Digit) ? StepEntry{A_Append, 0} :
+       cls == SC_Quote ? StepEntry{A_Step, 0} : StepEntry{A_Emit, 0}) :
+
+    state == S_PPNumber ?
+      (cls == SC_E ? StepEntry{A_AppendGoto, S_PPNumberExpectSign} :
+       (cls == SC_Letter || cls == SC_Digit || cls == SC_Dot) ? StepEntry{A_Append, 0} :
+       StepEntry{A_Emit, 0}) :
+
+    state == S_PPNumberExpectSign ?
+      ((cls == SC_Quote || cls == SC_Space || cls == SC_Break) ? StepEntry{A_Emit, 0} :
+       cls == SC_E ? StepEntry{A_Append, 0} :
+       StepEntry{A_AppendGoto, S_PPNumber}) :
+
+    (state == S_EndCharacterLiteral || state == S_EndNormalStringLiteral ||
+     state == S_EndRawStringLiteral) ?
+      ((cls == SC_Letter || cls == SC_E) ?
+         StepEntry{A_AppendGoto, static_cast<unsigned char>(
+           state == S_EndCharacterLiteral ? S_UserDefinedCharacterLiteral : S_UserDefinedNormalStringLiteral)} :
+       StepEntry{A_Emit, 0}) :
+
+    (state == S_UserDefinedCharacterLiteral || state == S_UserDefinedNormalStringLiteral ||
+     state == S_UserDefinedRawStringLiteral) ?
+      ((cls == SC_Letter || cls == SC_E || cls == SC_Digit) ? StepEntry{A_Append, 0} :
+       StepEntry{A_Emit, 0}) :
+
+    StepEntry{A_Step, 0};
+}
+
+#define STEP_ROW(state) \
+  { \
+    stepEntry(state, SC_Other), stepEntry(state, SC_Letter), stepEntry(state, SC_E), \
+    stepEntry(state, SC_Digit), stepEntry(state, SC_Dot), stepEntry(state, SC_Sign), \
+    stepEntry(state, SC_Quote), stepEntry(state, SC_Space), stepEntry(state, SC_Break) \
+  }
+
+const PPTokenizer::StepEntry PPTokenizer::StepTable[S_Count][SC_Count] =
+  {
+    STEP_ROW(S_None),
+    STEP_ROW(S_Identifier),
+    STEP_ROW(S_HeaderName),
+    STEP_ROW(S_PPNumber),
+    STEP_ROW(S_PPNumberExpectSign),
+    STEP_ROW(S_StartCharacterLiteral),
+    STEP_ROW(S_EndCharacterLiteral),
+    STEP_ROW(S_UserDefinedCharacterLiteral),
+    STEP_ROW(S_StartNormalStringLiteral),
+    STEP_ROW(S_EndNormalStringLiteral),
+    STEP_ROW(S_UserDefinedNormalStringLiteral),
+    STEP_ROW(S_StartRawStringLiteralDChar),
+    STEP_ROW(S_StartRawStringLiteralRChar),
+    STEP_ROW(S_EndRawStringLiteral),
+    STEP_ROW(S_UserDefinedRawStringLiteral),
+    STEP_ROW(S_StartOpOrPunc)
+  };
+
+#undef STEP_ROW
+
 void PPTokenizer::step(int cp) {
 
+  const StepEntry &entry = StepTable[state_][
+    static_cast<unsigned>(cp) < 0x100 ? StepClassTable[cp] : SC_Other];
+
+  switch (entry.action) {
+    case A_Append:
+      append(cp);
+      return;
+    case A_AppendGoto:
+      append(cp);
+      state_ = static_cast<State>(entry.next);
+      return;
+    case A_Emit:
+      emit(cp, true);
+      return;
+    case A_Begin:
+      is_prev_whitespace_ = false;
+      append(cp);
+      state_ = static_cast<State>(entry.next);
+      return;
+    case A_Space:
+      if (!is_prev_whitespace_) {
+        output.emit_whitespace_sequence();
+        is_prev_whitespace_ = true;
+      }
+      return;
+    default:
+      break;
+  }
+
   switch (state_) {
     case S_None:
       step_None(cp);
@@ -681,9 +1084,6 @@ void PPTokenizer::step(int cp) {
     case S_StartRawStringLiteralRChar:
       step_StartRawStringLiteralRChar(cp);
       break;
-    case S_MayBeEndRawStringLiteralRChar:
-      step_MayBeEndRawStringLiteralRChar(cp);
-      break;
     case S_EndRawStringLiteral:
       step_EndRawStringLiteral(cp);
       break;
@@ -695,15 +1095,56 @@ void PPTokenizer::step(int cp) {
   }
 }
 
+void PPTokenizer::append(int c) {
+  if (data_.empty()) {
+    token_begin_ = cursor_;
+  } else if (cursor_ != token_end_) {
+    token_begin_ = nullptr;
+  }
+  if (token_begin_ != nullptr) {
+    token_end_ = cursor_ + 1;
+  }
+  if (c < 0x80) {
+    data_.push_back(static_cast<char>(c));
+  } else {
+    data_.append(codePoint2String(c));
+  }
+}
+
+// appends a run of ASCII code units that the current state copies
+// verbatim, as step() would one at a time
+void PPTokenizer::appendRun(const char *begin, const char *end) {
+  if (begin == end) {
+    return;
+  }
+  cursor_ = begin;
+  append(static_cast<unsigned char>(*begin));
+  if (token_begin_ != nullptr) {
+    token_end_ = end;
+  }
+  data_.append(begin + 1, end);
+  cursor_ = end - 1;
+
+  last_but_one_code_point_ = end - begin > 1 ?
+    static_cast<unsigned char>(end[-2]) : last_code_point_;
+  last_code_point_ = static_cast<unsigned char>(end[-1]);
+}
+
+PPTokenView PPTokenizer::spelling() {
+  if (token_begin_ != nullptr) {
+    return PPTokenView{token_begin_, static_cast<size_t>(token_end_ - token_begin_)};
+  }
+  return PPTokenView{data_.data(), data_.size()};
+}
+
 void PPTokenizer::emit(int c, bool cont) {
 
-  string data;
+  PPTokenView data = spelling();
 
   switch (state_) {
     case S_Identifier: {
-      data = codePoints2String(data_);
-
-      if (Digraph_IdentifierLike_Operators.find(data) != Digraph_IdentifierLike_Operators.end()) {
+      if (data.size <= MaxIdentifierLikeOperatorSize &&
+          Digraph_IdentifierLike_Operators.find(data.str()) != Digraph_IdentifierLike_Operators.end()) {
         output.emit_preprocessing_op_or_punc(data);
       } else {
         output.emit_identifier(data);
@@ -718,52 +1159,40 @@ void PPTokenizer::emit(int c, bool cont) {
       break;
     }
     case S_HeaderName: {
-      data = codePoints2String(data_);
       output.emit_header_name(data);
       is_prev_include_ = false;
       break;
     }
     case S_EndCharacterLiteral: {
-      data = codePoints2String(data_);
       output.emit_character_literal(data);
       break;
     }
     case S_UserDefinedCharacterLiteral: {
-      data = codePoints2String(data_);
       output.emit_user_defined_character_literal(data);
       break;
     }
 
     case S_EndNormalStringLiteral:
     case S_EndRawStringLiteral: {
-      data = codePoints2String(data_);
       output.emit_string_literal(data);
       break;
     }
 
     case S_UserDefinedNormalStringLiteral:
     case S_UserDefinedRawStringLiteral: {
-      data = codePoints2String(data_);
       output.emit_user_defined_string_literal(data);
       break;
     }
 
     case S_PPNumber:
     case S_PPNumberExpectSign: {
-      data = codePoints2String(data_);
       output.emit_pp_number(data);
       break;
     }
 
-    case S_StartOpOrPunc: {
-      data = codePoints2String(data_);
-      is_prev_pound_key_ = false;
-      if (is_prev_new_line_ && data == "#") {
-        is_prev_pound_key_ = true;
-      }
-      output.emit_preprocessing_op_or_punc(data);
+    case S_StartOpOrPunc:
+      emitOpOrPunc(data);
       break;
-    }
     default:
       ASSERT(false, "invalid state");
   }
@@ -776,11 +1205,18 @@ void PPTokenizer::emit(int c, bool cont) {
   }
 }
 
+// data is the whole candidate or, when it is split, the match at its front
+void PPTokenizer::emitOpOrPunc(const PPTokenView &data) {
+  is_prev_pound_key_ = is_prev_new_line_ && data == "#";
+  output.emit_preprocessing_op_or_punc(data);
+  is_prev_new_line_ = false;
+}
+
 void PPTokenizer::step_None(int c) {
 
   ASSERT(data_.empty(), "buffer must be empty");
 
-  if (c < 0x7f && std::isspace(c) && c != LF) {
+  if (hasCharClass(c, CC_Space) && c != LF) {
     if (!is_prev_whitespace_) {
       output.emit_whitespace_sequence();
       is_prev_whitespace_ = true;
@@ -802,15 +1238,15 @@ void PPTokenizer::step_None(int c) {
   } else if (isIdentifierNonDigit(c)) {
     // identifier
     state_ = S_Identifier;
-    data_.push_back(c);
-  } else if (std::isdigit(c)) {
+    append(c);
+  } else if (isDigit(c)) {
     // pp-number
     state_ = S_PPNumber;
-    data_.push_back(c);
+    append(c);
   } else if ('\'' == c) {
     // character-literal or user-defined-character-literal
     state_ = S_StartCharacterLiteral;
-    data_.push_back(c);
+    append(c);
   } else if ('"' == c) {
     // string-literal or user-defined-string-literal
     if (is_prev_include_) {
@@ -819,36 +1255,38 @@ void PPTokenizer::step_None(int c) {
       state_ = S_StartNormalStringLiteral;
       is_normal_string_mode_ = true;
     }
-    data_.push_back(c);
-  } else if (SingleCharacter_Op_or_Punc.find(c) != SingleCharacter_Op_or_Punc.end()) {
+    append(c);
+  } else if (hasCharClass(c, CC_OpOrPunc)) {
     // preprocessing-op-or-punc
     if (is_prev_include_) {
       state_ = S_HeaderName;
+      append(c);
     } else {
       state_ = S_StartOpOrPunc;
+      op_node_ = OpOrPuncRoot;
+      step_OpOrPunc(c);
     }
-    data_.push_back(c);
   } else {
     // each non-white-space character that cannot be one of the above
-    string data = codePoint2String(c);
-    output.emit_non_whitespace_char(data);
+    spelling_ = codePoint2String(c);
+    output.emit_non_whitespace_char(PPTokenView{spelling_.data(), spelling_.size()});
   }
 }
 
 void PPTokenizer::step_Identifier(int c) {
-  if (isNonDigit(c) || std::isdigit(c) || isInAnnexE1(c)) {
-    data_.push_back(c);
+  if (isIdentifierChar(c)) {
+    append(c);
   } else if ('\'' == c && isCharacterLiteralPrefix(data_)) {
-    data_.push_back(c);
+    append(c);
     state_ = S_StartCharacterLiteral;
     inner_state_ = Inner_None;
   } else if ('"' == c && isNormalStringLiteralPrefix(data_)) {
-    data_.push_back(c);
+    append(c);
     state_ = S_StartNormalStringLiteral;
     is_normal_string_mode_ = true;
     inner_state_ = Inner_None;
   } else if ('"' == c && isRawStringLiteralPrefix(data_)) {
-    data_.push_back(c);
+    append(c);
     state_ = S_StartRawStringLiteralDChar;
     is_raw_string_mode_ = true;
     inner_state_ = Inner_None;
@@ -859,18 +1297,18 @@ void PPTokenizer::step_Identifier(int c) {
 
 void PPTokenizer::step_PPNumber(int c) {
   if (c == 'E' || c == 'e') {
-    data_.push_back(c);
+    append(c);
     state_ = S_PPNumberExpectSign;
-  } else if (c == '.' || std::isdigit(c) || isIdentifierNonDigit(c)) {
-    data_.push_back(c);
+  } else if (c == '.' || isDigit(c) || isIdentifierNonDigit(c)) {
+    append(c);
   } else {
     emit(c, true);
   }
 }
 
 void PPTokenizer::step_PPNumberExpectSign(int c) {
-  if (c == '+' || c == '-' || c == '.' || std::isdigit(c) || isIdentifierNonDigit(c)) {
-    data_.push_back(c);
+  if (c == '+' || c == '-' || c == '.' || isDigit(c) || isIdentifierNonDigit(c)) {
+    append(c);
     state_ = S_PPNumber;
   } else {
     emit(c, true);
@@ -880,112 +1318,71 @@ void PPTokenizer::step_PPNumberExpectSign(int c) {
 void PPTokenizer::step_HeaderName(int c) {
   ASSERT(!data_.empty() && (data_.front() == '<' || data_.front() == '"'),
          "incorrect header name buffer");
-  data_.push_back(c);
+  append(c);
   if ((data_.front() == '<' && c == '>') || (data_.front() == '"' && c == '"')) {
     emit(c, false);
   }
 }
 
-vector<int> PPTokenizer::splitOpOrPunc(string &data, int c) {
-  vector<int> remaining;
-
-  while (!data.empty()) {
-    if (data.size() == 4 && FourCharacter_Op_or_Punc.find(data) != FourCharacter_Op_or_Punc.end()) {
-      if (data == "<::>" || data == "<:::") {
-        ASSERT(data_.size() == 4, "buffer size must be 4");
-        for (auto i = 0; i < 2; i++) {
-          remaining.push_back(data_.back());
-          data_.pop_back();
-        }
-      }
-      emit(c, false);
-      break;
-    } else if (data.size() == 3 && ThreeCharacter_Op_or_Punc.find(data) != ThreeCharacter_Op_or_Punc.end()) {
+void PPTokenizer::step_OpOrPunc(int c) {
+  int node = static_cast<unsigned>(c) < 0x80 ? OpOrPuncNext[op_node_][OpOrPuncColumn[c]] : OpOrPuncRoot;
 
-      if (data == "<::") {
-        ASSERT(data_.size() >= 3, "buffer size must greater than or equal to 3");
-        for (auto i = 0; i < 2; i++) {
-          remaining.push_back(data_.back());
-          data_.pop_back();
-        }
-      }
-      while (data_.size() > 3) {
-        remaining.push_back(data_.back());
-        data_.pop_back();
-      }
+  if (node != OpOrPuncRoot) {
+    append(c);
+    op_node_ = node;
+    return;
+  }
 
+  if (op_node_ == OpOrPuncDot && isDigit(c)) {
+    state_ = S_PPNumber;
+    append(c);
+    return;
+  }
 
-      emit(c, false);
-      break;
-    } else if (data.size() == 2 && TwoCharacter_Op_or_Punc.find(data) != TwoCharacter_Op_or_Punc.end()) {
-      while (data_.size() > 2) {
-        remaining.push_back(data_.back());
-        data_.pop_back();
-      }
+  splitOpOrPunc(c);
 
-      emit(c, false);
-      break;
-    } else if (data.size() == 1) {
-      while (data_.size() > 1) {
-        remaining.push_back(data_.back());
-        data_.pop_back();
-      }
+  if (state_ == S_StartOpOrPunc) {
+    step_OpOrPunc(c);
+  } else {
+    step_None(c);
+  }
+}
 
-      emit(c, false);
-      break;
-    }
+// emit the longest preprocessing-op-or-punc of a candidate that c cannot
+// extend, the at most two characters after it stay as the next candidate
+void PPTokenizer::splitOpOrPunc(int c) {
+  size_t size = OpOrPuncMatch[op_node_];
+  int rest = OpOrPuncRest[op_node_];
 
-    data.pop_back();
-    remaining.push_back(data_.back());
-    data_.pop_back();
+  // <:: followed by neither : nor > is < :: (C++ standard 2.5p3)
+  if (op_node_ == OpOrPuncLessColonColon && c != ':' && c != '>') {
+    size = 1;
+    rest = OpOrPuncColonColon;
   }
 
-  return remaining;
-}
-
-void PPTokenizer::step_OpOrPunc(int c) {
+  if (rest == OpOrPuncRoot) {
+    emit(c, false);
+    return;
+  }
 
-  string data;
-  vector<int> buf;
-
-  data_.push_back(c);
-
-  if (SingleCharacter_Op_or_Punc.find(c) != SingleCharacter_Op_or_Punc.end()) {
-    data = codePoints2String(data_);
-    if (data.size() == 4) {
-      buf = splitOpOrPunc(data, c);
-      state_ = S_None;
-      std::reverse(buf.begin(), buf.end());
-      for (const int cp : buf) {
-        step(cp);
-      }
-    }
-  } else {
-    data_.pop_back();
-    if (data_.size() == 1 && data_.front() == '.' && c < 0x7f && std::isdigit(c)) {
-      state_ = S_PPNumber;
-      data_.push_back(c);
-    } else {
-      data = codePoints2String(data_);
-      buf = splitOpOrPunc(data, c);
-      state_ = S_None;
-      std::reverse(buf.begin(), buf.end());
-      for (const int cp : buf) {
-        step(cp);
-      }
-      step(c);
-    }
+  PPTokenView data = spelling();
+  data.size = size;
+  emitOpOrPunc(data);
 
+  data_.erase(0, size);
+  if (token_begin_ != nullptr) {
+    token_begin_ += size;
   }
+  op_node_ = rest;
 }
 
 void PPTokenizer::step_StartCharacterLiteral(int c) {
-  if (LF == c) {
+  if (LF == c || c == EndOfFile) {
     throw "unterminated character literal";
   }
   switch (inner_state_) {
     case Inner_None:
-      data_.push_back(c);
+      append(c);
       if (c == '\'') {
         state_ = S_EndCharacterLiteral;
       } else if (c == '\\') {
@@ -993,10 +1390,10 @@ void PPTokenizer::step_StartCharacterLiteral(int c) {
       }
       break;
     case Inner_BackSlash:
-      data_.push_back(c);
+      append(c);
       if (c == 'x') {
         inner_state_ = Inner_Hex;
-      } else if (SimpleEscapeSequence_CodePoints.find(c) != SimpleEscapeSequence_CodePoints.end()) {
+      } else if (hasCharClass(c, CC_SimpleEscape)) {
         inner_state_ = Inner_None;
       } else if (c >= '0' && c <= '7') {
         inner_state_ = Inner_Oct1;
@@ -1006,7 +1403,7 @@ void PPTokenizer::step_StartCharacterLiteral(int c) {
       break;
     case Inner_Oct1:
       if (c >= '0' && c <= '7') {
-        data_.push_back(c);
+        append(c);
         inner_state_ = Inner_Oct2;
       } else {
         inner_state_ = Inner_None;
@@ -1016,14 +1413,14 @@ void PPTokenizer::step_StartCharacterLiteral(int c) {
     case Inner_Oct2:
       inner_state_ = Inner_None;
       if (c >= '0' && c <= '7') {
-        data_.push_back(c);
+        append(c);
       } else {
         step_StartCharacterLiteral(c);
       }
       break;
     case Inner_Hex:
       if (isHex(c)) {
-        data_.push_back(c);
+        append(c);
       } else {
         if (data_.back() == 'x') {
           throw "invalid hex escape sequence";
@@ -1037,12 +1434,53 @@ void PPTokenizer::step_StartCharacterLiteral(int c) {
   }
 }
 
+const char *PPTokenizer::scanQuotedLiteralBody(const char *p, const char *end) {
+
+  bool is_string = state_ == S_StartNormalStringLiteral;
+  char quote = is_string ? '"' : '\'';
+  const char *run = p;
+
+  while ((p = findSpecialCodeUnit(p, end)) != end) {
+    char c = *p;
+    if (c == quote) {
+      appendRun(run, ++p);
+      if (is_string) {
+        state_ = S_EndNormalStringLiteral;
+        is_normal_string_mode_ = false;
+      } else {
+        state_ = S_EndCharacterLiteral;
+      }
+      return p;
+    }
+
+    if (c == '"' || c == '\'' || (c == '/' && is_string) ||
+        (c == '?' && end - p > 1 && p[1] != '?')) {
+      ++p;
+      continue;
+    }
+    if (c == '\\') {
+      const char *escape_end = skipEscapeSequence(p, end);
+      if (escape_end != p) {
+        p = escape_end;
+        continue;
+      }
+    }
+
+    // new-lines, trigraphs, splices, UCNs, comments in character literals
+    // and non-ASCII code units take the per-code-unit path
+    break;
+  }
+
+  appendRun(run, p);
+  return p;
+}
+
 void PPTokenizer::step_EndCharacterLiteral(int c) {
 
   ASSERT(state_ == S_EndCharacterLiteral, "current state must be S_EndCharacterLiteral");
 
   if (isIdentifierNonDigit(c)) {
-    data_.push_back(c);
+    append(c);
     state_ = S_UserDefinedCharacterLiteral;
   } else {
     emit(c, true);
@@ -1054,13 +1492,13 @@ void PPTokenizer::step_UserDefinedCharacterLiteral(int c) {
 }
 
 void PPTokenizer::step_StartNormalStringLiteral(int c) {
-  if (LF == c) {
+  if (LF == c || c == EndOfFile) {
     throw "unterminated string literal";
   }
 
   switch (inner_state_) {
     case Inner_None:
-      data_.push_back(c);
+      append(c);
       if (c == '"') {
         state_ = S_EndNormalStringLiteral;
         is_normal_string_mode_ = false;
@@ -1069,10 +1507,10 @@ void PPTokenizer::step_StartNormalStringLiteral(int c) {
       }
       break;
     case Inner_BackSlash:
-      data_.push_back(c);
+      append(c);
       if (c == 'x') {
         inner_state_ = Inner_Hex;
-      } else if (SimpleEscapeSequence_CodePoints.find(c) != SimpleEscapeSequence_CodePoints.end()) {
+      } else if (hasCharClass(c, CC_SimpleEscape)) {
         inner_state_ = Inner_None;
       } else if (c >= '0' && c <= '7') {
         inner_state_ = Inner_Oct1;
@@ -1082,7 +1520,7 @@ void PPTokenizer::step_StartNormalStringLiteral(int c) {
       break;
     case Inner_Oct1:
       if (c >= '0' && c <= '7') {
-        data_.push_back(c);
+        append(c);
         inner_state_ = Inner_Oct2;
       } else {
         inner_state_ = Inner_None;
@@ -1092,14 +1530,14 @@ void PPTokenizer::step_StartNormalStringLiteral(int c) {
     case Inner_Oct2:
       inner_state_ = Inner_None;
       if (c >= '0' && c <= '7') {
-        data_.push_back(c);
+        append(c);
       } else {
         step_StartNormalStringLiteral(c);
       }
       break;
     case Inner_Hex:
       if (isHex(c)) {
-        data_.push_back(c);
+        append(c);
       } else {
         if (data_.back() == 'x') {
           throw "invalid hex escape sequence";
@@ -1117,7 +1555,7 @@ void PPTokenizer::step_EndNormalStringLiteral(int c) {
   ASSERT(state_ == S_EndNormalStringLiteral, "current state must be S_EndNormalStringLiteral");
 
   if (isIdentifierNonDigit(c)) {
-    data_.push_back(c);
+    append(c);
     state_ = S_UserDefinedNormalStringLiteral;
   } else {
     emit(c, true);
@@ -1129,14 +1567,16 @@ void PPTokenizer::step_UserDefinedNormalStringLiteral(int c) {
 }
 
 void PPTokenizer::step_StartRawStringLiteralDChar(int c) {
-  if (std::isspace(c) || c == ')' || c == '\\' || c == '"') {
+  if (hasCharClass(c, CC_Space) || c == ')' || c == '\\' || c == '"') {
     throw "invalid characters in raw string delimiter";
   }
-  data_.push_back(c);
+  append(c);
   if (c == '(') {
     state_ = S_StartRawStringLiteralRChar;
+  } else if (c < 0x80) {
+    prefix_.push_back(static_cast<char>(c));
   } else {
-    prefix_.push_back(c);
+    prefix_.append(codePoint2String(c));
   }
 }
 
@@ -1144,69 +1584,59 @@ void PPTokenizer::step_StartRawStringLiteralRChar(int c) {
 
   ASSERT(!data_.empty(), "buffer must not be empty");
 
-  data_.push_back(c);
-
-  if (is_prev_right_paren_) {
-    if (std::isspace(c) || c == ')' || c == '(' || c == '\\') {
-      if (c != ')') {
-        is_prev_right_paren_ = false;
-      }
-    } else {
-      is_prev_right_paren_ = false;
+  if (c == EndOfFile) {
+    throw "unterminated raw string literal";
+  }
 
-      ASSERT(compare_index_ == 0, "compare index must be zero");
+  append(c);
 
-      if (compare_index_ == prefix_.size()) {
-        if (c == '"') {
-          state_ = S_EndRawStringLiteral;
-          is_raw_string_mode_ = false;
-        } else {
-          throw "unterminated raw string literal";
-        }
-      } else {
-        if (c == prefix_[compare_index_]) {
-          compare_index_++;
-          state_ = S_MayBeEndRawStringLiteralRChar;
-        } else {
-          compare_index_ = 0;
-        }
-      }
-    }
-  } else {
-    if (c == ')') {
-      is_prev_right_paren_ = true;
-    }
+  if (c == '"' && isRawStringLiteralEnd()) {
+    state_ = S_EndRawStringLiteral;
+    is_raw_string_mode_ = false;
+    prefix_.clear();
   }
 }
 
-void PPTokenizer::step_MayBeEndRawStringLiteralRChar(int c) {
+// true when the token ends with the )d-char-sequence" of its delimiter
+bool PPTokenizer::isRawStringLiteralEnd() const {
+  size_t n = prefix_.size() + 2;
+  return data_.size() >= n && data_[data_.size() - n] == ')' &&
+         data_.compare(data_.size() - n + 1, prefix_.size(), prefix_) == 0;
+}
+
+const char *PPTokenizer::scanRawStringBody(const char *p, const char *end) {
 
-  data_.push_back(c);
+  size_t n = prefix_.size();
 
-  if (compare_index_ == prefix_.size()) {
-    compare_index_ = 0;
-    if (c == '"') {
+  // a delimiter the per-code-unit path has started to match is left to it
+  if (data_.find(')', data_.size() - min(data_.size(), n + 1)) != string::npos) {
+    return p;
+  }
+
+  const char *run = p;
+
+  // jump from ')' to ')' and match the whole delimiter at once
+  while ((p = findRawStringCodeUnit(p, end)) != end && *p == ')' &&
+         static_cast<size_t>(end - p) >= n + 2) {
+    if (p[n + 1] == '"' && memcmp(p + 1, prefix_.data(), n) == 0) {
+      p += n + 2;
+      appendRun(run, p);
       state_ = S_EndRawStringLiteral;
       is_raw_string_mode_ = false;
-      is_prev_right_paren_ = false;
       prefix_.clear();
-    } else {
-      state_ = S_StartRawStringLiteralRChar;
-    }
-  } else {
-    if (c == prefix_[compare_index_]) {
-      compare_index_++;
-    } else {
-      compare_index_ = 0;
-      state_ = S_StartRawStringLiteralRChar;
+      return p;
     }
+    ++p;
   }
+
+  appendRun(run, p);
+  return p;
 }
 
 void PPTokenizer::step_EndRawStringLiteral(int c) {
 
   if (isIdentifierNonDigit(c)) {
-    data_.push_back(c);
+    append(c);
     state_ = S_UserDefinedNormalStringLiteral;
   } else {
     emit(c, true);
@@ -1218,8 +1648,8 @@ void PPTokenizer::step_UserDefinedRawStringLiteral(int c) {
 }
 
 void PPTokenizer::step_UserDefinedSuffix(int c) {
-  if (isNonDigit(c) || std::isdigit(c) || isInAnnexE1(c)) {
-    data_.push_back(c);
+  if (isIdentifierChar(c)) {
+    append(c);
   } else {
     emit(c, true);
   }
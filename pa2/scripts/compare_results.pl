@@ -50,7 +50,25 @@ for my $test (sort @tests)
 		print "TEST FAIL\n";
 		exit(1);
 	}
-	elsif ($reftest_exit_status_data =~ /EXIT_FAILURE/ or ($reftest_data eq $mytest_data))
+	elsif ($reftest_exit_status_data =~ /EXIT_FAILURE/)
+	{
+		# the error message may differ, the output before it may not
+		(my $reftest_head = $reftest_data) =~ s/[^\n]*\z//;
+		(my $mytest_head = $mytest_data) =~ s/[^\n]*\z//;
+
+		if ($reftest_head ne $mytest_head)
+		{
+			print "ERROR: Output before the error does not match reference implementation\n";
+			print "\n";
+			print "To see the differences of output:\n\n    \$ diff $reftest $mytest\n\n";
+			print "TEST FAIL\n";
+			exit(1);
+		}
+
+		$npass++;
+		print "PASS\n\n";
+	}
+	elsif ($reftest_data eq $mytest_data)
 	{
 		$npass++;
 		print "PASS\n\n";
@@ -0,0 +1,122 @@
+#!/usr/bin/perl
+
+# Generates OpOrPunc.h: a trie over the spellings of preprocessing-op-or-punc,
+# for maximal munch in a single forward pass. Each node also records the
+# longest preprocessing-op-or-punc its spelling starts with and the node of
+# what is left after it, so that a candidate no character can extend is split
+# without stepping through its tail again.
+#
+# Usage: scripts/gen_op_or_punc.pl > OpOrPunc.h
+
+use strict;
+use warnings;
+
+my $indent = "  ";
+
+# See C++ standard 2.13 Operators and punctuators
+my @op_or_punc = (
+	"{", "}", "[", "]", "#", "(", ")", ";", ":", "?", ".",
+	"+", "-", "*", "/", "%", "^", "&", "|", "~", "!", "=", "<", ">", ",",
+	"##", "<:", ":>", "<%", "%>", "%:", "::", ".*", "->",
+	"+=", "-=", "*=", "/=", "%=", "^=", "&=", "|=", "==",
+	"!=", "<=", ">=", "&&", "||", "<<", ">>", "++", "--",
+	"...", "->*", "<=>", "<<=", ">>=", "%:%:",
+);
+
+# <:: is only looked past, see C++ standard 2.5p3
+my @prefixes = ("<::");
+
+# nodes the tokenizer refers to by name
+my %named = (
+	"Root"           => "",
+	"Dot"            => ".",
+	"ColonColon"     => "::",
+	"LessColonColon" => "<::",
+);
+
+my %accepts = map { $_ => 1 } @op_or_punc;
+
+# nodes are numbered in order of their spelling, the root first
+my %node;
+for my $spelling (@op_or_punc, @prefixes)
+{
+	$node{substr($spelling, 0, $_)} = 1 for 0 .. length($spelling);
+}
+my @spellings = sort { length($a) <=> length($b) || $a cmp $b } keys %node;
+$node{$spellings[$_]} = $_ for 0 .. $#spellings;
+die "too many nodes" if @spellings > 256;
+
+my @chars = sort { ord($a) <=> ord($b) } keys %{{ map { $_ => 1 } map { split(//) } @op_or_punc }};
+my %column = map { $chars[$_] => $_ + 1 } 0 .. $#chars;
+
+sub quote
+{
+	my ($spelling) = @_;
+	return "\"$spelling\"";
+}
+
+print "// Generated by scripts/gen_op_or_punc.pl, do not edit.\n";
+print "//\n";
+print "// Trie over the spellings of preprocessing-op-or-punc (C++ standard 2.13),\n";
+print "// with <:: as an extra path so that the character after it can be seen.\n";
+print "\n";
+print "#pragma once\n";
+print "\n";
+print "#include <cstdint>\n";
+print "\n";
+
+for my $name (sort { $node{$named{$a}} <=> $node{$named{$b}} } keys %named)
+{
+	printf "static const int OpOrPunc%s = %d; // %s\n", $name, $node{$named{$name}}, quote($named{$name});
+}
+print "\n";
+
+print "// column of each ASCII character in OpOrPuncNext, 0 if it is in no spelling\n";
+print "static const uint8_t OpOrPuncColumn[128] = {\n";
+for (my $i = 0; $i < 128; $i += 16)
+{
+	print $indent, join(", ", map { $column{chr($_)} // 0 } $i .. $i + 15), ",\n";
+}
+print "};\n\n";
+
+print "// node reached from a node on a column, OpOrPuncRoot if the character\n";
+print "// cannot extend the node's spelling\n";
+printf "static const uint8_t OpOrPuncNext[%d][%d] = {\n", scalar(@spellings), scalar(@chars) + 1;
+for my $spelling (@spellings)
+{
+	my @next = (0, map { $node{$spelling . $_} // 0 } @chars);
+	print $indent, "{", join(", ", @next), "}, // ", quote($spelling), "\n";
+}
+print "};\n\n";
+
+# longest preprocessing-op-or-punc that a spelling starts with
+my (@match, @rest);
+for my $spelling (@spellings)
+{
+	my $size = length($spelling);
+	$size-- while $size > 0 && !$accepts{substr($spelling, 0, $size)};
+	die "no preprocessing-op-or-punc starts \"$spelling\"" if $size == 0 && $spelling ne "";
+	my $tail = substr($spelling, $size);
+	die "no node for \"$tail\"" if !exists $node{$tail};
+	push @match, $size;
+	push @rest, $node{$tail};
+}
+
+print "// length of the longest preprocessing-op-or-punc a node's spelling starts with\n";
+printf "static const uint8_t OpOrPuncMatch[%d] = {\n", scalar(@spellings);
+for (my $i = 0; $i < @match; $i += 16)
+{
+	my $last = $i + 15 < $#match ? $i + 15 : $#match;
+	print $indent, join(", ", @match[$i .. $last]), ",\n";
+}
+print "};\n\n";
+
+print "// node of what is left of a node's spelling after that match, OpOrPuncRoot\n";
+print "// if nothing is\n";
+printf "static const uint8_t OpOrPuncRest[%d] = {\n", scalar(@spellings);
+for (my $i = 0; $i < @rest; $i += 16)
+{
+	my $last = $i + 15 < $#rest ? $i + 15 : $#rest;
+	print $indent, join(", ", @rest[$i .. $last]), ",\n";
+}
+print "};\n";